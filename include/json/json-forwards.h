@@ -319,8 +319,13 @@ class Features;
 // value.h
 typedef unsigned int ArrayIndex;
 class StaticString;
+class KeyInternTable;
+struct AllocationStats;
+struct MemoryUsage;
 class Path;
 class PathArgument;
+class PathQuery;
+class PathQuerySet;
 class Value;
 class ValueIteratorBase;
 class ValueIterator;
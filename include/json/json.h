@@ -265,6 +265,18 @@ license you like.
 #  define JSON_USE_INT64_DOUBLE_CONVERSION 1
 #endif
 
+// Count the heap allocations made for Value trees (see AllocationStats).
+// Opt-in: the counters are shared by every thread. The library and all of its
+// users must be built with the same setting.
+#if !defined(JSONCPP_ALLOCATION_STATS)
+#  define JSONCPP_ALLOCATION_STATS 0
+#endif
+
+// CBOR tag marking an unsigned integer that must be read back as uintValue.
+#if !defined(JSONCPP_CBOR_UINT_TAG)
+#define JSONCPP_CBOR_UINT_TAG 35402
+#endif
+
 #if !defined(JSON_IS_AMALGAMATION)
 
 # include "version.h"
@@ -352,8 +364,13 @@ class Features;
 // value.h
 typedef unsigned int ArrayIndex;
 class StaticString;
+class KeyInternTable;
+struct AllocationStats;
+struct MemoryUsage;
 class Path;
 class PathArgument;
+class PathQuery;
+class PathQuerySet;
 class Value;
 class ValueIteratorBase;
 class ValueIterator;
@@ -465,6 +482,7 @@ public:
 #include <string>
 #include <vector>
 #include <exception>
+#include <memory>
 
 #ifndef JSON_USE_CPPTL_SMALLMAP
 #include <map>
@@ -574,6 +592,89 @@ enum PrecisionType {
 //   typedef CppTL::AnyEnumerator<const Value &> EnumValues;
 //# endif
 
+/** \brief Process-wide counters of the heap allocations made by this library
+ * for Value trees: string values, member names, containers, map nodes and
+ * comments (but not the temporary buffers of readers and writers).
+ *
+ * Disabled (always zero) when JSONCPP_ALLOCATION_STATS is 0.
+ */
+struct JSON_API AllocationStats {
+  LargestUInt allocations_; ///< allocations since start-up
+  LargestUInt releases_;    ///< releases since start-up
+  LargestUInt bytesInUse_;  ///< bytes requested and not released yet
+
+  /// Snapshot of the counters.
+  static AllocationStats current();
+};
+
+#if JSONCPP_ALLOCATION_STATS
+/// used internally
+void JSON_API countAllocation(size_t bytes);
+/// used internally
+void JSON_API countRelease(size_t bytes);
+#endif // if JSONCPP_ALLOCATION_STATS
+
+/// Allocator of the object and array maps, which feeds AllocationStats.
+/// The type is the same in every configuration (so is Value::ObjectValues);
+/// only the counting depends on JSONCPP_ALLOCATION_STATS.
+template <typename T> class CountingAllocator : public std::allocator<T> {
+public:
+  typedef T value_type;
+  typedef size_t size_type;
+  typedef T* pointer;
+
+  template <typename U> struct rebind { typedef CountingAllocator<U> other; };
+
+  CountingAllocator() {}
+  CountingAllocator(const CountingAllocator&) : std::allocator<T>() {}
+  template <typename U>
+  CountingAllocator(const CountingAllocator<U>&) : std::allocator<T>() {}
+
+  pointer allocate(size_type n, const void* = 0) {
+    pointer p = std::allocator<T>::allocate(n);
+#if JSONCPP_ALLOCATION_STATS
+    countAllocation(n * sizeof(T));
+#endif
+    return p;
+  }
+  void deallocate(pointer p, size_type n) {
+#if JSONCPP_ALLOCATION_STATS
+    countRelease(n * sizeof(T));
+#endif
+    std::allocator<T>::deallocate(p, n);
+  }
+
+  template <typename U> bool operator==(const CountingAllocator<U>&) const {
+    return true;
+  }
+  template <typename U> bool operator!=(const CountingAllocator<U>&) const {
+    return false;
+  }
+};
+
+/** \brief Heap used by a Value tree, as reported by Value::memoryUsage().
+ *
+ * Bytes are the sizes requested from the allocator; map nodes are estimated
+ * as the stored pair plus four pointers of tree bookkeeping.
+ */
+struct JSON_API MemoryUsage {
+  struct Category {
+    LargestUInt bytes_;
+    LargestUInt allocations_;
+  };
+  Category strings_;  ///< string values
+  Category keys_;     ///< duplicated member names (not static nor interned)
+  Category objects_;  ///< maps and map nodes of object values
+  Category arrays_;   ///< maps and map nodes of array values
+  Category comments_; ///< comment slots and texts
+
+  MemoryUsage();
+  /// Sum of all categories.
+  LargestUInt bytes() const;
+  /// Sum of all categories.
+  LargestUInt allocations() const;
+};
+
 /** \brief Lightweight wrapper to tag static string.
  *
  * Value constructor and objectValue member assignment takes advantage of the
@@ -600,6 +701,41 @@ private:
   const char* c_str_;
 };
 
+/** \brief Process-wide table of shared, immutable object member names.
+ *
+ * A name added to the table is stored once, null-terminated, together with a
+ * precomputed hash, and is never released. When the CharReaderBuilder setting
+ * "internKeys" is true, the parser stores members whose name is in the table
+ * with the shared copy as a static key instead of duplicating it, and key
+ * comparisons between two interned names reduce to a pointer comparison.
+ *
+ * The table has a fixed capacity (JSONCPP_KEY_INTERN_CAPACITY slots, half of
+ * which may be used) so that untrusted input can never grow it: only names
+ * added explicitly through intern() are shared.
+ * All functions are thread-safe; find() does not lock.
+ *
+ * Example of usage:
+ * \code
+ * Json::KeyInternTable::intern("confidence");
+ * Json::CharReaderBuilder builder;
+ * builder["internKeys"] = true;
+ * \endcode
+ */
+class JSON_API KeyInternTable {
+public:
+  /// Add [begin, end) to the table if needed and return the shared copy.
+  /// \return NULL if the table is full or the name contains embedded zeroes.
+  static char const* intern(char const* begin, char const* end);
+  /// Same as intern(char const*, char const*), but 'key' is null-terminated.
+  static char const* intern(char const* key);
+  /// Return the shared copy of [begin, end), or NULL if it was never added.
+  static char const* find(char const* begin, char const* end);
+  /// Number of names in the table.
+  static ArrayIndex size();
+  /// Hash used by the table.
+  static unsigned hash(char const* begin, char const* end);
+};
+
 /** \brief Represents a <a HREF="http://www.json.org">JSON</a> value.
  *
  * This class is a discriminated union wrapper that can represents a:
@@ -636,6 +772,7 @@ private:
  */
 class JSON_API Value {
   friend class ValueIteratorBase;
+  friend class CborCharReader;
 public:
   typedef std::vector<JSONCPP_STRING> Members;
   typedef ValueIterator iterator;
@@ -737,7 +874,9 @@ private:
 
 public:
 #ifndef JSON_USE_CPPTL_SMALLMAP
-  typedef std::map<CZString, Value> ObjectValues;
+  typedef std::map<CZString, Value, std::less<CZString>,
+                   CountingAllocator<std::pair<const CZString, Value> > >
+      ObjectValues;
 #else
   typedef CppTL::SmallMap<CZString, Value> ObjectValues;
 #endif // ifndef JSON_USE_CPPTL_SMALLMAP
@@ -1054,6 +1193,11 @@ Json::Value obj_value(Json::objectValue); // {}
 
   JSONCPP_STRING toStyledString() const;
 
+  /// Heap used by this value and all of its children.
+  MemoryUsage memoryUsage() const;
+  /// Add the heap used by this value and all of its children to usage.
+  void addMemoryUsage(MemoryUsage& usage) const;
+
   const_iterator begin() const;
   const_iterator end() const;
 
@@ -1075,6 +1219,7 @@ private:
 
   Value& resolveReference(const char* key);
   Value& resolveReference(const char* key, const char* end);
+  Value& resolveStaticReference(const char* key, const char* end);
 
   struct CommentInfo {
     CommentInfo();
@@ -1176,6 +1321,126 @@ private:
   Args args_;
 };
 
+/** \brief Precompiled "path" for nodes that are looked up repeatedly.
+ *
+ * The path is parsed once and its member names are stored with their lengths
+ * in a single buffer, so resolving it does no parsing, no strlen() and no
+ * allocation.
+ *
+ * Syntax is the same as Path (without the '%' parameters) plus wildcards:
+ * - "entities.intent[0].value"
+ * - ".entities.*.confidence" => member 'confidence' of every member of entities
+ * - ".outcomes[*]._text" => member '_text' of every element of outcomes
+ */
+class JSON_API PathQuery {
+public:
+  PathQuery();
+  explicit PathQuery(const JSONCPP_STRING& path);
+
+  /// Return false if the path could not be compiled (e.g. an index that
+  /// doesn't fit ArrayIndex).
+  bool isValid() const;
+  /// Return the first node matching the path, or null.
+  const Value& resolve(const Value& root) const;
+  /// Return the first node matching the path, defaultValue otherwise.
+  /// \note deep copy
+  Value resolve(const Value& root, const Value& defaultValue) const;
+  /** \brief Collect the nodes matching a path containing wildcards.
+   * \param results [out] receives at most maxResults pointers into root.
+   * \return the number of matching nodes, which may exceed maxResults.
+   */
+  ArrayIndex resolveAll(const Value& root,
+                        const Value** results,
+                        ArrayIndex maxResults) const;
+
+private:
+  friend class PathQuerySet;
+
+  enum Kind {
+    kindIndex = 0,
+    kindKey,
+    kindAnyIndex,
+    kindAnyKey
+  };
+  struct Step {
+    Kind kind_;
+    ArrayIndex index_;  // array index, or offset of the name in keys_
+    unsigned length_;   // length of the name
+  };
+  typedef std::vector<Step> Steps;
+
+  static bool compile(const JSONCPP_STRING& path,
+                      JSONCPP_STRING& keys,
+                      Steps& steps);
+  static const Value* step(const Value& node,
+                           const Step& s,
+                           const JSONCPP_STRING& keys);
+  const Value* resolveFrom(const Value& node, size_t first) const;
+  void collectFrom(const Value& node,
+                   size_t first,
+                   const Value** results,
+                   ArrayIndex maxResults,
+                   ArrayIndex& found) const;
+
+  JSONCPP_STRING keys_;
+  Steps steps_;
+  bool valid_;
+};
+
+/** \brief Several PathQuery resolved together in a single walk of the tree.
+ *
+ * The paths are merged into a prefix tree, so a member shared by several
+ * paths (e.g. "entities") is looked up only once per document.
+ *
+ * Example of usage:
+ * \code
+ * Json::PathQuerySet queries;
+ * Json::ArrayIndex const text = queries.add("_text");
+ * Json::ArrayIndex const intent = queries.add("entities.intent[0].value");
+ * Json::ArrayIndex const confidence = queries.add("entities.intent[0].confidence");
+ * const Json::Value* found[3];
+ * queries.resolve(root, found);
+ * \endcode
+ */
+class JSON_API PathQuerySet {
+public:
+  PathQuerySet();
+
+  /// Compile path and return its slot in the results of resolve().
+  /// \throw std::exception if the path is not valid.
+  ArrayIndex add(const JSONCPP_STRING& path);
+  /// Number of paths added so far.
+  ArrayIndex size() const;
+  /** \brief Resolve every path against root.
+   * \param results [out] must hold size() pointers. Each one receives the
+   *        first node matching the corresponding path, or Value::nullSingleton().
+   */
+  void resolve(const Value& root, const Value** results) const;
+
+private:
+  struct Node {
+    PathQuery::Step step_;
+    ArrayIndex firstChild_;  // index in nodes_, or 0 if none
+    ArrayIndex nextSibling_; // index in nodes_, or 0 if none
+    ArrayIndex slot_;        // result slot ending here, or noSlot
+  };
+  typedef std::vector<Node> Nodes;
+  enum { noSlot = ~0u };
+
+  static bool isSameStep(const PathQuery::Step& a,
+                         const JSONCPP_STRING& aKeys,
+                         const PathQuery::Step& b,
+                         const JSONCPP_STRING& bKeys);
+  void walk(const Value& value,
+            ArrayIndex node,
+            const Value** results,
+            ArrayIndex& missing) const;
+
+  JSONCPP_STRING keys_;
+  Nodes nodes_;  // nodes_[0] is the root; children are chained from it
+  ArrayIndex slots_;
+};
+
 /** \brief base class for Value iterators.
  *
  */
@@ -1701,6 +1966,16 @@ public:
     - `"allowSpecialFloats": false or true`
       - If true, special float values (NaNs and infinities) are allowed 
         and their values are lossfree restorable.
+    - `"internKeys": false or true`
+      - If true, object member names found in the KeyInternTable share its
+        storage instead of being duplicated into every document.
+    - `"parallelArrayThreads": integer`
+      - If greater than 1, a document whose root is an array is pre-scanned
+        for element boundaries and its elements are parsed on that many
+        threads. -1 uses one thread per hardware thread; 0 disables it.
+        Documents with comments fall back to the serial parser.
+    - `"parallelArrayMinSize": integer`
+      - Smallest document, in bytes, parsed in parallel.
 
     You can examine 'settings_` yourself
     to see the defaults. You can also write and read them just like any
@@ -1737,6 +2012,63 @@ public:
   static void strictMode(Json::Value* settings);
 };
 
+/** \brief Build a CharReader that reads <a HREF="http://cbor.io">CBOR</a>
+ * (RFC 7049), as written by CborStreamWriterBuilder.
+
+Every #ValueType round-trips exactly. Comments and source offsets are not
+stored. Definite and indefinite lengths, half/single/double precision floats,
+byte strings (read as strings) and unknown tags (ignored) are accepted.
+
+Usage:
+\code
+  Json::CborCharReaderBuilder builder;
+  builder["referenceKeys"] = true;
+  std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+  Json::Value value;
+  JSONCPP_STRING errs;
+  bool ok = reader->parse(mappedBegin, mappedEnd, &value, &errs);
+\endcode
+*/
+class JSON_API CborCharReaderBuilder : public CharReader::Factory {
+public:
+  /** Configuration of this builder.
+    Available settings (case-sensitive):
+    - `"referenceKeys": false or true`
+      - If true, object member names are not copied: the Value refers to them
+        inside the parsed buffer (e.g. a memory-mapped file), which must then
+        outlive the Value and all of its copies. Only the names followed by a
+        null byte in the buffer are referenced; the others are copied.
+    - `"internKeys": false or true`
+      - If true, member names found in the KeyInternTable share its storage.
+    - `"stackLimit": integer`
+      - Exceeding stackLimit (nesting depth) will cause an exception.
+    - `"failIfExtra": false or true`
+      - If true, `parse()` returns false when bytes trail the encoded value.
+
+    \sa setDefaults()
+    */
+  Json::Value settings_;
+
+  CborCharReaderBuilder();
+  ~CborCharReaderBuilder() JSONCPP_OVERRIDE;
+
+  CharReader* newCharReader() const JSONCPP_OVERRIDE;
+
+  /** \return true if 'settings' are legal and consistent;
+   *   otherwise, indicate bad settings via 'invalid'.
+   */
+  bool validate(Json::Value* invalid) const;
+
+  /** A simple way to update a specific setting.
+   */
+  Value& operator[](JSONCPP_STRING key);
+
+  /** Called by ctor, but you can use this to reset settings_.
+   * \pre 'settings' != NULL (but Json::null is fine)
+   */
+  static void setDefaults(Json::Value* settings);
+};
+
 /** Consume entire stream and use its begin/end.
   * Someday we might have a real StreamReader, but for now this
   * is convenient.
@@ -1939,6 +2271,50 @@ public:
   static void setDefaults(Json::Value* settings);
 };
 
+/** \brief Build a StreamWriter that writes <a HREF="http://cbor.io">CBOR</a>
+ * (RFC 7049) instead of JSON text.
+
+Integers use the shortest encoding. A #uintValue small enough to be read back
+as an #intValue is preceded by tag JSONCPP_CBOR_UINT_TAG so that its type
+round-trips.
+
+Usage:
+\code
+  Json::CborStreamWriterBuilder builder;
+  JSONCPP_STRING bytes = Json::writeString(builder, value);
+\endcode
+*/
+class JSON_API CborStreamWriterBuilder : public StreamWriter::Factory {
+public:
+  /** Configuration of this builder.
+    Available settings (case-sensitive):
+    - "shortestFloat": false or true
+      - If true, real values which a single precision float represents exactly
+        are written in 4 bytes instead of 8.
+
+    \sa setDefaults()
+    */
+  Json::Value settings_;
+
+  CborStreamWriterBuilder();
+  ~CborStreamWriterBuilder() JSONCPP_OVERRIDE;
+
+  StreamWriter* newStreamWriter() const JSONCPP_OVERRIDE;
+
+  /** \return true if 'settings' are legal and consistent;
+   *   otherwise, indicate bad settings via 'invalid'.
+   */
+  bool validate(Json::Value* invalid) const;
+  /** A simple way to update a specific setting.
+   */
+  Value& operator[](JSONCPP_STRING key);
+
+  /** Called by ctor, but you can use this to reset settings_.
+   * \pre 'settings' != NULL (but Json::null is fine)
+   */
+  static void setDefaults(Json::Value* settings);
+};
+
 /** \brief Abstract class for writers.
  * \deprecated Use StreamWriter. (And really, this is an implementation detail.)
  */
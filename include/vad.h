@@ -23,6 +23,80 @@
  * The "audio powers" are average of audio chunks in DBFS. It could also be PCM samples...
  */
 
+/*
+ frame energies are attenuations in dB below full scale.
+ define WVS_FIXED_POINT to compute them with integers only, in Q8 fixed point (256 is 1 dB),
+ e.g for processors without a fast fpu. thresholds in wvs_params stay in dB.
+ */
+#ifdef WVS_FIXED_POINT
+typedef int32_t wvs_energy;
+typedef int64_t wvs_energy_sum;
+#define WVS_ENERGY_SCALE 256
+#else
+typedef double wvs_energy;
+typedef double wvs_energy_sum;
+#define WVS_ENERGY_SCALE 1
+#endif
+
+/*
+ how the energy of a frame is measured.
+ */
+typedef enum {
+    /* dB of the mean power of the frame: one log per frame, vectorised (the default of wvs_default_params) */
+    WVS_ENERGY_POWER,
+    
+    /* mean of the DBFS of every non-zero sample: the original measure, kept by wvs_init */
+    WVS_ENERGY_DBFS_MEAN
+} wvs_energy_mode;
+
+/*
+ the detector engine.
+ */
+typedef enum {
+    /* frame energy against an adaptive noise floor (default) */
+    WVS_ENGINE_ENERGY,
+    
+    /* sub-band log energies scored by per-band speech and noise gaussian models, adapted online.
+     it copes better with stationary noise (hum, fans) that keeps the energy engine talking.
+     it works on floats, even in WVS_FIXED_POINT builds, and needs at least 8000 Hz */
+    WVS_ENGINE_SPECTRAL
+} wvs_engine;
+
+/* state of the spectral engine, private to vad.c */
+typedef struct wvs_spectral wvs_spectral;
+
+/*
+ tuning of the detector. get the defaults from wvs_default_params and change what you need.
+ */
+typedef struct {
+    /* how far (in dB) a frame must be above the noise floor to be speech (8.0) */
+    double energy_threshold;
+    
+    /* frames used to learn the noise floor before any decision (30) */
+    int init_frames;
+    
+    /* length of a frame in milliseconds (10) */
+    int frame_ms;
+    
+    /* consecutive speech frames needed to start talking (10) */
+    int onset_frames;
+    
+    /* consecutive non-speech frames needed to stop talking (30) */
+    int offset_frames;
+    
+    /* the noise floor is a running average over at most this many frames; lower adapts faster (10) */
+    int adaptation_frames;
+    
+    /* how the frame energy is measured (WVS_ENERGY_POWER) */
+    wvs_energy_mode energy_mode;
+    
+    /* the detector engine (WVS_ENGINE_ENERGY). energy_threshold, adaptation_frames and energy_mode only apply to WVS_ENGINE_ENERGY */
+    wvs_engine engine;
+    
+    /* WVS_ENGINE_SPECTRAL: weighted log likelihood ratio of speech over noise above which a frame is speech (2.5) */
+    double spectral_threshold;
+} wvs_params;
+
 /* 
  state of the voice activity detection algorithm.
  */
@@ -36,14 +110,36 @@ typedef struct  {
     /* frame number needed for initialization */
     int init_frames;
     
-    double energy_threshold;
+    /* in WVS_ENERGY_SCALE units */
+    wvs_energy energy_threshold;
     
-    double min_energy;
+    /* the noise floor, in WVS_ENERGY_SCALE units */
+    wvs_energy min_energy;
     
+    /* ring buffer of the last frame decisions (1 for speech, 0 otherwise) */
     int *previous_state;
     
+    /* the larger of talk_frames and stop_frames */
     int previous_state_maxlen;
     
+    /* index of the newest decision in previous_state */
+    int previous_state_head;
+    
+    /* number of consecutive speech frames needed to start talking */
+    int talk_frames;
+    
+    /* number of consecutive non-speech frames needed to stop talking */
+    int stop_frames;
+    
+    /* speech frames among the last talk_frames decisions */
+    int speech_frames_short;
+    
+    /* speech frames among the last stop_frames decisions */
+    int speech_frames_long;
+    
+    /* cap of the weight of the noise floor running average */
+    int adaptation_frames;
+    
     int talking;
     
     /* number of sample per second */
@@ -52,20 +148,204 @@ typedef struct  {
     /* number of samples needed to calculate the feature(s) */
     int samples_per_frame;
     
-    /* samples list to send to the checking function when enough are available */
-    double *samples;
+    /* how the frame energy is measured (see wvs_energy_mode) */
+    wvs_energy_mode energy_mode;
+    
+    /* WVS_ENERGY_DBFS_MEAN: sum of the DBFS of the samples of the current frame */
+    wvs_energy_sum frame_energy;
+    
+    /* WVS_ENERGY_POWER: sum of the squared samples of the current frame */
+    uint64_t frame_power;
     
+    /* number of samples accumulated in frame_energy */
     int current_nb_samples;
+    
+    /* number of samples fed since wvs_init */
+    int64_t stream_offset;
+    
+    wvs_engine engine;
+    
+    /* WVS_ENGINE_SPECTRAL only */
+    wvs_spectral *spectral;
 } wvs_state;
 
-int wvs_still_talking(wvs_state *state, int16_t *samples, int nb_samples);
+/*
+ a change of the talking state, reported by wvs_process.
+ */
+typedef enum {
+    WVS_SPEECH_START,
+    WVS_SPEECH_END
+} wvs_event_type;
+
+typedef struct {
+    wvs_event_type type;
+    
+    /* sample offset of the boundary from the beginning of the stream:
+     the first sample of the speech for WVS_SPEECH_START, the one after its last sample for WVS_SPEECH_END.
+     exact with WVS_ENERGY_POWER; WVS_ENERGY_DBFS_MEAN frames skip the zero samples, so it is approximate there */
+    int64_t offset;
+} wvs_event;
+
+/**
+ * wvs_still_talking - feed a chunk of audio to the detector
+ *  @state: the detector state
+ *  @samples: pcm 16 bits samples, of any count. They are read in place and never copied
+ *  @nb_samples: number of samples
+ *
+ *  Return 0 when the speaker stopped talking, 1 otherwise. Does not allocate.
+ */
+int wvs_still_talking(wvs_state *state, const int16_t *samples, int nb_samples);
+
+/**
+ * wvs_process - feed a chunk of audio to the detector and get the speech boundaries it revealed
+ *  @state: the detector state
+ *  @samples: pcm 16 bits samples, of any count. They are read in place and never copied
+ *  @nb_samples: number of samples
+ *  @events: receives the events, in order
+ *  @max_events: size of events. There is at most one event per frame,
+ *   so nb_samples / samples_per_frame + 1 is always enough
+ *
+ *  Unlike wvs_still_talking, the whole chunk is always processed.
+ *  Return the number of events that happened (only the first max_events are stored). Does not allocate.
+ */
+int wvs_process(wvs_state *state, const int16_t *samples, int nb_samples, wvs_event *events, int max_events);
 
+/**
+ * wvs_init - create a detector with the default parameters, but the original WVS_ENERGY_DBFS_MEAN measure
+ *  @threshold: the energy threshold in dB, or 0 (or less) for the default
+ *  @sample_rate: number of sample per second
+ *
+ *  The decisions are the ones of the versions before wvs_params. Use wvs_init_params for WVS_ENERGY_POWER.
+ *
+ *  Return NULL on failure.
+ */
 wvs_state *wvs_init(double threshold, int sample_rate);
 
+/**
+ * wvs_default_params - fill a wvs_params with the default tuning
+ *  @params: the structure to fill
+ */
+void wvs_default_params(wvs_params *params);
+
+/**
+ * wvs_init_params - create a detector with the given parameters
+ *  @params: the tuning. It is copied
+ *  @sample_rate: number of sample per second
+ *
+ *  Return NULL on failure or when a parameter is out of range.
+ */
+wvs_state *wvs_init_params(const wvs_params *params, int sample_rate);
+
+/**
+ * wvs_set_energy_mode - choose how the frame energy is measured
+ *  @state: the detector state
+ *  @mode: the measure. Switching resets the current (partial) frame.
+ */
+void wvs_set_energy_mode(wvs_state *state, wvs_energy_mode mode);
+
 /**
  * wvs_clean - clean a wvs_state* structure
  *  @state: the structure to free.
  */
 void wvs_clean(wvs_state *state);
 
+/*
+ state of the detector for many channels at once, in struct-of-arrays form.
+ every channel uses the WVS_ENERGY_POWER measure and gets the decisions wvs_still_talking would give it.
+ */
+typedef struct {
+    int nb_channels;
+    
+    /* number of samples of each channel in a frame */
+    int samples_per_frame;
+    
+    /* frame number needed for initialization */
+    int init_frames;
+    
+    /* in WVS_ENERGY_SCALE units */
+    wvs_energy energy_threshold;
+    
+    /* number of consecutive speech frames needed to start talking */
+    int talk_frames;
+    
+    /* number of consecutive non-speech frames needed to stop talking */
+    int stop_frames;
+    
+    /* cap of the weight of the noise floor running average */
+    int adaptation_frames;
+    
+    /* the larger of talk_frames and stop_frames */
+    int previous_state_maxlen;
+    
+    /* frame number of each channel */
+    int *sequence;
+    
+    /* the noise floor of each channel, in WVS_ENERGY_SCALE units */
+    wvs_energy *min_energy;
+    
+    /* talking bitmap: channel c is bit (c % 32) of talking[c / 32] */
+    uint32_t *talking;
+    
+    /* ring buffer of the last frame decisions, previous_state_maxlen rows of nb_channels */
+    uint8_t *previous_state;
+    
+    /* row of the newest decisions in previous_state */
+    int previous_state_head;
+    
+    /* speech frames of each channel among the last talk_frames decisions */
+    int *speech_frames_short;
+    
+    /* speech frames of each channel among the last stop_frames decisions */
+    int *speech_frames_long;
+    
+    /* sum of the squared samples of each channel in the last frame */
+    uint64_t *frame_power;
+} wvs_batch;
+
+/**
+ * wvs_batch_init - create a detector for many channels
+ *  @nb_channels: number of channels
+ *  @threshold: the energy threshold in dB, or 0 (or less) for the default
+ *  @sample_rate: number of sample per second of every channel
+ *
+ *  Return NULL on failure.
+ */
+wvs_batch *wvs_batch_init(int nb_channels, double threshold, int sample_rate);
+
+/**
+ * wvs_batch_init_params - create a detector for many channels with the given parameters
+ *  @nb_channels: number of channels
+ *  @params: the tuning. It is copied, and its energy_mode is ignored (always WVS_ENERGY_POWER).
+ *   Only WVS_ENGINE_ENERGY is supported
+ *  @sample_rate: number of sample per second of every channel
+ *
+ *  Return NULL on failure or when a parameter is out of range.
+ */
+wvs_batch *wvs_batch_init_params(int nb_channels, const wvs_params *params, int sample_rate);
+
+/**
+ * wvs_batch_process - feed one frame of every channel to the detector
+ *  @batch: the detector
+ *  @samples: samples_per_frame interleaved pcm 16 bits samples of each channel (samples[i * nb_channels + channel])
+ *
+ *  Updates the talking bitmap and returns the number of talking channels. Does not allocate.
+ *  Only the energy accumulation, which reads every sample, runs as one SIMD pass over the channels
+ *  (AVX2, SSE2 or NEON). The decisions (dB conversion, noise floor, windows and bitmap) are then made
+ *  channel by channel in plain c, with the same log10 as wvs_still_talking so that they stay identical.
+ */
+int wvs_batch_process(wvs_batch *batch, const int16_t *samples);
+
+/**
+ * wvs_batch_reset_channel - start a channel over, e.g for a new call on it
+ *  @batch: the detector
+ *  @channel: the channel
+ */
+void wvs_batch_reset_channel(wvs_batch *batch, int channel);
+
+/**
+ * wvs_batch_clean - free a wvs_batch* structure
+ *  @batch: the structure to free.
+ */
+void wvs_batch_clean(wvs_batch *batch);
+
 #endif
@@ -36,6 +36,32 @@ freely, subject to the following restrictions:
 #include <algorithm>
 #include <memory>
 #include <functional>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <stdexcept>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <set>
+#if defined(__unix__) || defined(__APPLE__)
+#define WITPP_HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#endif
+//the audio kernels use SSE2 or NEON when the compiler targets them, and plain c++ otherwise
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#define WITPP_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define WITPP_NEON
+#include <arm_neon.h>
+#endif
 #include <json/json.h>
 #include <curl/curl.h>
 #ifdef VAD_ENABLED
@@ -61,6 +87,19 @@ stream->read(static_cast<char*>(buf), sz*items);
 return stream->gcount();
 }
 
+#ifdef WITPP_INTERN_KEYS
+//this function adds the member names found in every wit.ai responce to jsoncpp's key intern table, so parsed responces share them
+inline bool internResponceKeys()
+{
+static const char* keys[]={"_text", "msg_id", "entities", "value", "confidence", "type", "expressions", "metadata", "values", "id", "name", "lang", "lookups", "builtin", "doc", "error", "code"};
+for(unsigned int i=0;i<sizeof(keys)/sizeof(keys[0]);i++)
+{
+Json::KeyInternTable::intern(keys[i]);
+}
+return true;
+}
+#endif //WITPP_INTERN_KEYS
+
 //this class represents a value for context
 class ContextValue
 {
@@ -409,6 +448,13 @@ public:
 Responce(std::string r)
 {
 Json::CharReaderBuilder builder;
+#ifdef WITPP_INTERN_KEYS
+static bool interned=internResponceKeys();
+builder["internKeys"]=interned;
+#endif //WITPP_INTERN_KEYS
+#ifdef WITPP_PARSE_THREADS
+builder["parallelArrayThreads"]=WITPP_PARSE_THREADS;
+#endif //WITPP_PARSE_THREADS
 std::stringstream stream;
 stream.str(r);
 std::string errors;
@@ -432,6 +478,12 @@ throw WitException(responce["error"].asString(), 0);
 }
 }
 
+//returns the heap held by the parsed responce (useful to size caches of responces)
+Json::MemoryUsage memoryUsage() const
+{
+return responce.memoryUsage();
+}
+
 };
 
 //this class is derived from Responce that shows a message (for MessageRequest and Speech Request)
@@ -665,35 +717,6 @@ throw WitException(httpcode);
 
 };
 
-#ifdef VAD_ENABLED
-
-class VoiceActivityDetector
-{
-wvs_state* state;
-public:
-VoiceActivityDetector(int sample_rate)
-{
-state=wvs_init(0, sample_rate);
-}
-
-~VoiceActivityDetector()
-{
-wvs_clean(state);
-}
-
-bool talking(int16_t* samples, int size)
-{
-if(wvs_still_talking(state, samples, size)==1)
-{
-return true;
-}
-return false;
-}
-
-};
-
-#endif //VAD_ENABLED
-
 typedef enum
 {
 BIG_ENDIAN,
@@ -719,274 +742,2917 @@ MS_ADPCM,
 GSM_FULL_RATE
 }EncodingType;
 
-typedef enum {
-RECORDING_STARTED,
-RECORDING_CONTINUE,
-RECORDING_STOPPED
-}RecordingStatus;
-
-typedef std::function<RecordingStatus (std::stringstream&)> SourceFunction;
-
-class VoiceRequest: public Request
+//this class converts 16 bit samples to G.711 mu-law or A-law (8 bits per sample, so half the bytes to upload). the output matches the reference encoder of the itu bit for bit
+//the segment search is done with the exponent of a float instead of a loop, so SSE2 and NEON encode 8 samples at a time. the samples left over (and the other targets) take the same arithmetic one at a time
+class G711
 {
-SourceFunction callback;
-int rate;
-std::string thread_id;
-std::string message_id;
-Context* context;
-int n_best;
-bool verbose;
 public:
+static void encodeMuLaw(const int16_t* samples, uint8_t* out, size_t size)
+{
+size_t i=0;
+#if defined(WITPP_SSE2)
+const __m128i zero=_mm_setzero_si128();
+const __m128i bias=_mm_set1_epi16(0x21);
+const __m128i clip=_mm_set1_epi16(0x1fff);
+const __m128i exponent=_mm_set1_epi32((127+5)<<4);
+const __m128i sign=_mm_set1_epi16(0x80);
+const __m128i mask=_mm_set1_epi16(0xff);
+for(; i+8<=size; i+=8)
+{
+__m128i v=_mm_srai_epi16(_mm_loadu_si128((const __m128i*)(samples+i)), 2);
+__m128i negative=_mm_srai_epi16(v, 15);
+__m128i m=_mm_min_epi16(_mm_add_epi16(_mm_sub_epi16(_mm_xor_si128(v, negative), negative), bias), clip);
+__m128i low=_mm_castps_si128(_mm_cvtepi32_ps(_mm_unpacklo_epi16(m, zero)));
+__m128i high=_mm_castps_si128(_mm_cvtepi32_ps(_mm_unpackhi_epi16(m, zero)));
+__m128i code=_mm_packs_epi32(_mm_sub_epi32(_mm_srli_epi32(low, 19), exponent), _mm_sub_epi32(_mm_srli_epi32(high, 19), exponent));
+code=_mm_xor_si128(code, _mm_xor_si128(mask, _mm_and_si128(negative, sign)));
+_mm_storel_epi64((__m128i*)(out+i), _mm_packus_epi16(code, code));
+}
+#elif defined(WITPP_NEON)
+const int32x4_t exponent=vdupq_n_s32((127+5)<<4);
+for(; i+8<=size; i+=8)
+{
+int16x8_t v=vshrq_n_s16(vld1q_s16(samples+i), 2);
+int16x8_t negative=vshrq_n_s16(v, 15);
+int16x8_t m=vminq_s16(vaddq_s16(vsubq_s16(veorq_s16(v, negative), negative), vdupq_n_s16(0x21)), vdupq_n_s16(0x1fff));
+int32x4_t low=vreinterpretq_s32_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(m))));
+int32x4_t high=vreinterpretq_s32_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(m))));
+int16x8_t code=vcombine_s16(vmovn_s32(vsubq_s32(vshrq_n_s32(low, 19), exponent)), vmovn_s32(vsubq_s32(vshrq_n_s32(high, 19), exponent)));
+code=veorq_s16(code, veorq_s16(vdupq_n_s16(0xff), vandq_s16(negative, vdupq_n_s16(0x80))));
+vst1_u8(out+i, vmovn_u16(vreinterpretq_u16_s16(code)));
+}
+#endif
+for(; i<size; i++)
+{
+int32_t v=samples[i]>>2;
+int32_t negative=v>>31;
+//the biased magnitude is at least 0x21, so its float exponent is the segment plus 5 and the top of its mantissa is the step
+int32_t m=std::min((v^negative)-negative+0x21, 0x1fff);
+float f=(float)m;
+int32_t bits;
+std::memcpy(&bits, &f, sizeof(bits));
+out[i]=(uint8_t)(((bits>>19)-((127+5)<<4))^(0xff^(negative&0x80)));
+}
+}
+
+static void encodeALaw(const int16_t* samples, uint8_t* out, size_t size)
+{
+size_t i=0;
+#if defined(WITPP_SSE2)
+const __m128i zero=_mm_setzero_si128();
+const __m128i exponent=_mm_set1_epi32((127+4)<<4);
+const __m128i segments=_mm_set1_epi16(64);
+const __m128i sign=_mm_set1_epi16(0x80);
+const __m128i mask=_mm_set1_epi16(0xd5);
+for(; i+8<=size; i+=8)
+{
+__m128i v=_mm_srai_epi16(_mm_loadu_si128((const __m128i*)(samples+i)), 3);
+__m128i negative=_mm_srai_epi16(v, 15);
+__m128i m=_mm_xor_si128(v, negative);
+__m128i low=_mm_castps_si128(_mm_cvtepi32_ps(_mm_unpacklo_epi16(m, zero)));
+__m128i high=_mm_castps_si128(_mm_cvtepi32_ps(_mm_unpackhi_epi16(m, zero)));
+__m128i segment=_mm_packs_epi32(_mm_sub_epi32(_mm_srli_epi32(low, 19), exponent), _mm_sub_epi32(_mm_srli_epi32(high, 19), exponent));
+__m128i linear=_mm_cmplt_epi16(m, segments);
+__m128i code=_mm_or_si128(_mm_and_si128(linear, _mm_srai_epi16(m, 1)), _mm_andnot_si128(linear, segment));
+code=_mm_xor_si128(code, _mm_xor_si128(mask, _mm_and_si128(negative, sign)));
+_mm_storel_epi64((__m128i*)(out+i), _mm_packus_epi16(code, code));
+}
+#elif defined(WITPP_NEON)
+const int32x4_t exponent=vdupq_n_s32((127+4)<<4);
+for(; i+8<=size; i+=8)
+{
+int16x8_t v=vshrq_n_s16(vld1q_s16(samples+i), 3);
+int16x8_t negative=vshrq_n_s16(v, 15);
+int16x8_t m=veorq_s16(v, negative);
+int32x4_t low=vreinterpretq_s32_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(m))));
+int32x4_t high=vreinterpretq_s32_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(m))));
+int16x8_t segment=vcombine_s16(vmovn_s32(vsubq_s32(vshrq_n_s32(low, 19), exponent)), vmovn_s32(vsubq_s32(vshrq_n_s32(high, 19), exponent)));
+int16x8_t code=vbslq_s16(vcltq_s16(m, vdupq_n_s16(64)), vshrq_n_s16(m, 1), segment);
+code=veorq_s16(code, veorq_s16(vdupq_n_s16(0xd5), vandq_s16(negative, vdupq_n_s16(0x80))));
+vst1_u8(out+i, vmovn_u16(vreinterpretq_u16_s16(code)));
+}
+#endif
+for(; i<size; i++)
+{
+int32_t v=samples[i]>>3;
+int32_t negative=v>>31;
+int32_t m=v^negative;
+float f=(float)m;
+int32_t bits;
+std::memcpy(&bits, &f, sizeof(bits));
+//the first two segments are linear
+int32_t linear=-(int32_t)(m<64);
+int32_t code=(linear&(m>>1))|(~linear&((bits>>19)-((127+4)<<4)));
+out[i]=(uint8_t)(code^(0xd5^(negative&0x80)));
+}
+}
+
+static void decodeMuLaw(const uint8_t* in, int16_t* out, size_t size)
+{
+static const std::vector<int16_t> table=muLawTable();
+for(size_t i=0; i<size; i++)
+{
+out[i]=table[in[i]];
+}
+}
 
-VoiceRequest():
-Request(),
-verbose(false),
-context(nullptr)
+static void decodeALaw(const uint8_t* in, int16_t* out, size_t size)
 {
-headers=curl_slist_append(headers, "Content-Type: audio/raw");
-headers=curl_slist_append(headers, "endian: little");
-headers=curl_slist_append(headers, "bits: 16");
-headers=curl_slist_append(headers, "encoding: unsigned-integer");
-setHost(getHost()+"speech");
-n_best=1;
-rate=16000;
+static const std::vector<int16_t> table=aLawTable();
+for(size_t i=0; i<size; i++)
+{
+out[i]=table[in[i]];
+}
 }
 
-VoiceRequest& setEndian(EndianType endian)
+private:
+static std::vector<int16_t> muLawTable()
 {
-switch(endian)
+std::vector<int16_t> table(256);
+for(int i=0; i<256; i++)
 {
-case BIG_ENDIAN:
-headers=curl_slist_append(headers, "endian: big");
-break;
-case LITTLE_ENDIAN:
-headers=curl_slist_append(headers, "endian: little");
-break;
+int u=~i;
+int t=(((u&0x0f)<<3)+0x84)<<((u&0x70)>>4);
+table[i]=(int16_t)((u&0x80)?(0x84-t):(t-0x84));
 }
-return *this;
+return table;
 }
 
-VoiceRequest& setBitType(BitsType type)
+static std::vector<int16_t> aLawTable()
 {
-switch(type)
+std::vector<int16_t> table(256);
+for(int i=0; i<256; i++)
 {
-case BIT_TYPE_8BIT:
-headers=curl_slist_append(headers, "bits: 8");
-break;
-case BIT_TYPE_16BIT:
-headers=curl_slist_append(headers, "bits: 16");
-break;
-case BIT_TYPE_32BIT:
-headers=curl_slist_append(headers, "bits: 32");
-break;
+int a=i^0x55;
+int t=(a&0x0f)<<4;
+int seg=(a&0x70)>>4;
+if(seg==0)
+{
+t+=8;
 }
-return *this;
+else
+{
+t=(t+0x108)<<(seg-1);
+}
+table[i]=(int16_t)((a&0x80)?t:-t);
+}
+return table;
 }
 
-VoiceRequest& setEncoding(EncodingType type)
+};
+
+//this class converts what your device records (any BitsType, EndianType and EncodingType, with interleaved channels) to 16 bit signed mono samples. the float conversion and the stereo downmix use SSE2 or NEON when the compiler targets them; the other kernels have no branches in their loops, which leaves them to the compilers
+class SampleConverter
 {
-switch(type)
+BitsType bits;
+EndianType endian;
+EncodingType encoding;
+int channels;
+std::vector<int16_t> interleaved;
+public:
+//throws std::invalid_argument for the formats that can't be converted (the adpcm and gsm encodings, floats that aren't 32 bit and G.711 that isn't 8 bit)
+SampleConverter(BitsType bits=BIT_TYPE_16BIT, EndianType endian=LITTLE_ENDIAN, EncodingType encoding=SIGNED_INTEGER, int channels=1):
+bits(bits),
+endian(endian),
+encoding(encoding),
+channels(channels)
+{
+bool valid=channels>=1;
+switch(encoding)
 {
 case SIGNED_INTEGER:
-headers=curl_slist_append(headers, "encoding: signed-integer");
-break;
 case UNSIGNED_INTEGER:
-headers=curl_slist_append(headers, "encoding: unsigned-integer");
 break;
 case FLOATING_POINT:
-headers=curl_slist_append(headers, "encoding: floating-point");
+valid=valid && bits==BIT_TYPE_32BIT;
 break;
 case MU_LAW:
-headers=curl_slist_append(headers, "encoding: mu-law");
-break;
 case A_LAW:
-headers=curl_slist_append(headers, "encoding: A_LAW");
-break;
-case IMA_ADPCM:
-headers=curl_slist_append(headers, "encoding: ima-adpcm");
-break;
-case MS_ADPCM:
-headers=curl_slist_append(headers, "encoding: ms-adpcm");
+valid=valid && bits==BIT_TYPE_8BIT;
 break;
-case GSM_FULL_RATE:
-headers=curl_slist_append(headers, "encoding: gsm-full-rate");
+default:
+valid=false;
 break;
 }
-return *this;
+if(!valid)
+{
+throw std::invalid_argument("unsupported sample format");
+}
 }
 
-VoiceRequest& setSourceCallback(SourceFunction cb)
+//the number of bytes of a frame (one sample of every channel)
+size_t getFrameSize() const
 {
-callback=cb;
-return *this;
+size_t size=(bits==BIT_TYPE_8BIT)?1:(bits==BIT_TYPE_16BIT)?2:4;
+return size*channels;
 }
 
-SourceFunction getSourceCallback()
+//converts whole frames and appends one mono sample per frame to out
+void convert(const char* data, size_t frames, std::vector<int16_t>& out)
 {
-return callback;
+size_t count=frames*channels;
+size_t old_size=out.size();
+int16_t* samples;
+if(channels==1)
+{
+out.resize(old_size+count);
+samples=out.data()+old_size;
 }
-
-VoiceRequest& setSampleRate(int sample_rate)
+else
 {
-rate=sample_rate;
+interleaved.resize(count);
+samples=interleaved.data();
 }
-
-int getSampleRate()
+bool swap=(endian==BIG_ENDIAN)!=isHostBigEndian();
+switch(bits)
 {
-return rate;
+case BIT_TYPE_8BIT:
+if(encoding==MU_LAW)
+{
+G711::decodeMuLaw((const uint8_t*)data, samples, count);
 }
-
-VoiceRequest& setMessageId(std::string id)
+else if(encoding==A_LAW)
 {
-message_id=id;
-return *this;
+G711::decodeALaw((const uint8_t*)data, samples, count);
 }
-
-std::string getMessageId()
+else if(encoding==UNSIGNED_INTEGER)
 {
-return message_id;
+unsigned8ToInt16((const uint8_t*)data, samples, count);
 }
-
-VoiceRequest& setThreadId(std::string id)
+else
 {
-thread_id=id;
-return *this;
+signed8ToInt16((const int8_t*)data, samples, count);
 }
-
-std::string getThreadId()
+break;
+case BIT_TYPE_16BIT:
+std::memcpy(samples, data, count*2);
+if(swap)
 {
-return thread_id;
+swapBytes16(samples, count);
 }
-
-VoiceRequest& setContext(Context* c)
+if(encoding==UNSIGNED_INTEGER)
 {
-context=c;
-return *this;
+flipSign16(samples, count);
 }
-
-Context getContext()
+break;
+case BIT_TYPE_32BIT:
+if(encoding==FLOATING_POINT)
 {
-return *context;
+floatToInt16(data, samples, count, swap);
 }
-
-VoiceRequest& setNBest(int n)
+else
 {
-n_best=n;
-return *this;
+int32ToInt16(data, samples, count, swap, encoding==UNSIGNED_INTEGER);
 }
-
-int getNBest()
+break;
+}
+if(channels==2)
 {
-return n_best;
+out.resize(old_size+frames);
+downmixStereo(samples, out.data()+old_size, frames);
 }
-
-VoiceRequest&setVerbose(bool v)
+else if(channels>2)
 {
-verbose=v;
-return *this;
+out.resize(old_size+frames);
+downmix(samples, out.data()+old_size, frames, channels);
+}
 }
 
-bool getVerbose()
+static bool isHostBigEndian()
 {
-return verbose;
+uint16_t one=1;
+uint8_t first;
+std::memcpy(&first, &one, 1);
+return first==0;
 }
 
-MessageResponce perform()
+//converts 32 bit floats (-1 to 1, clipped) with rounding
+static void floatToInt16(const char* in, int16_t* out, size_t size, bool swap)
 {
-std::string s="";
-s+="?v="+param.getVersion();
-if(context!=nullptr)
+size_t i=0;
+#if defined(WITPP_SSE2)
+const __m128 scale=_mm_set1_ps(32768.0f);
+const __m128 low=_mm_set1_ps(-32768.0f);
+const __m128 high=_mm_set1_ps(32767.0f);
+const __m128 half=_mm_set1_ps(0.5f);
+const __m128 sign=_mm_set1_ps(-0.0f);
+for(; i+8<=size; i+=8)
 {
-std::string ctx=(std::string)*context;
-s+="&context="+(std::string)curl_escape(ctx.c_str(), ctx.length());
-}
-if(message_id!="")
+__m128i words[2];
+for(int k=0; k<2; k++)
 {
-s+="&msg_id="+(std::string)curl_escape(message_id.c_str(), message_id.length());
-}
-if(thread_id!="")
+__m128i v=_mm_loadu_si128((const __m128i*)(in+4*(i+4*k)));
+if(swap)
 {
-s+="&thread_id="+(std::string)curl_escape(thread_id.c_str(), thread_id.length());
+v=_mm_or_si128(_mm_or_si128(_mm_srli_epi32(v, 24), _mm_slli_epi32(v, 24)), _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 8), _mm_set1_epi32(0xff00)), _mm_and_si128(_mm_slli_epi32(v, 8), _mm_set1_epi32(0xff0000))));
 }
-s+="&n="+n_best;
-s+="&verbose="+verbose?"1":"0";
-std::string token_header="Authorization: Bearer "+param.getAuth();
-headers=curl_slist_append(headers, token_header.c_str());
-std::string url=host+s;
-res=curl_easy_setopt(c, CURLOPT_URL, url.c_str());
-res=curl_easy_setopt(c, CURLOPT_HTTPHEADER, headers);
-res=curl_easy_setopt(c, CURLOPT_FOLLOWLOCATION, 1L);
-if(getTimeout()!=0)
-{
-res=curl_easy_setopt(c, CURLOPT_TIMEOUT, getTimeout());
+//min takes its second operand when the first is a nan, as std::min does
+__m128 f=_mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_castsi128_ps(v), scale), high), low);
+//rounds half away from zero
+f=_mm_add_ps(f, _mm_or_ps(half, _mm_and_ps(f, sign)));
+words[k]=_mm_cvttps_epi32(f);
 }
-int r=RECORDING_STARTED;
-std::stringstream stream;
-do
+_mm_storeu_si128((__m128i*)(out+i), _mm_packs_epi32(words[0], words[1]));
+}
+#elif defined(WITPP_NEON)
+const float32x4_t low=vdupq_n_f32(-32768.0f);
+const float32x4_t high=vdupq_n_f32(32767.0f);
+for(; i+8<=size; i+=8)
 {
-r=callback(stream);
-if(r==RECORDING_CONTINUE)
+int32x4_t words[2];
+for(int k=0; k<2; k++)
 {
-stream.flush();
-}
-}while(r!=RECORDING_STOPPED);
-res=curl_easy_setopt(c, CURLOPT_POST, 1L);
-std::string str=stream.str();
-res=curl_easy_setopt(c, CURLOPT_POSTFIELDS, str.c_str());
-std::unique_ptr<std::string> data(new std::string());;
-res=curl_easy_setopt(c, CURLOPT_WRITEDATA, data.get());
-res=curl_easy_perform(c);
-int httpcode;
-curl_easy_getinfo(c, CURLINFO_RESPONSE_CODE, &httpcode);
-if(httpcode==200)
+uint8x16_t v=vld1q_u8((const uint8_t*)in+4*(i+4*k));
+if(swap)
 {
-return MessageResponce(*data.get());
+v=vrev32q_u8(v);
 }
-else
+float32x4_t f=vmulq_n_f32(vreinterpretq_f32_u8(v), 32768.0f);
+//a nan gives the upper bound, as std::min does
+f=vmaxq_f32(vbslq_f32(vcltq_f32(f, high), f, high), low);
+//rounds half away from zero
+uint32x4_t negative=vcltq_f32(f, vdupq_n_f32(0.0f));
+f=vaddq_f32(f, vbslq_f32(negative, vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f)));
+words[k]=vcvtq_s32_f32(f);
+}
+vst1q_s16(out+i, vcombine_s16(vmovn_s32(words[0]), vmovn_s32(words[1])));
+}
+#endif
+for(; i<size; i++)
 {
-throw WitException(httpcode);
+uint32_t v;
+std::memcpy(&v, in+4*i, 4);
+if(swap)
+{
+v=(v>>24)|((v>>8)&0xff00)|((v<<8)&0xff0000)|(v<<24);
+}
+float f;
+std::memcpy(&f, &v, 4);
+f=std::max(-32768.0f, std::min(32767.0f, f*32768.0f));
+out[i]=(int16_t)(int32_t)(f+(f<0?-0.5f:0.5f));
 }
 }
 
-};
-
-//this class represents a responce for getting entities
-class EntitiesResponce: public Responce
+//keeps the 16 most significant bits of 32 bit integers
+static void int32ToInt16(const char* in, int16_t* out, size_t size, bool swap, bool is_unsigned)
 {
-public:
-
-EntitiesResponce(std::string s):
-Responce(s)
+uint32_t flip=is_unsigned?0x80000000u:0;
+for(size_t i=0; i<size; i++)
+{
+uint32_t v;
+std::memcpy(&v, in+4*i, 4);
+if(swap)
 {
+v=(v>>24)|((v>>8)&0xff00)|((v<<8)&0xff0000)|(v<<24);
+}
+out[i]=(int16_t)((v^flip)>>16);
+}
+}
 
+//switches 16 bit samples between big and little endian
+static void swapBytes16(int16_t* samples, size_t size)
+{
+for(size_t i=0; i<size; i++)
+{
+uint16_t v=(uint16_t)samples[i];
+samples[i]=(int16_t)((v<<8)|(v>>8));
+}
 }
 
-std::vector<std::string> getEntities()
+//switches 16 bit samples between unsigned and signed
+static void flipSign16(int16_t* samples, size_t size)
 {
-std::vector<std::string> data;
-for(unsigned int i=0;i<responce.size();i++)
+for(size_t i=0; i<size; i++)
 {
-data.push_back(responce[i].asString());
+samples[i]=(int16_t)((uint16_t)samples[i]^0x8000);
 }
-return data;
 }
 
-};
+//switches 8 bit samples between unsigned and signed
+static void flipSign8(uint8_t* samples, size_t size)
+{
+for(size_t i=0; i<size; i++)
+{
+samples[i]^=0x80;
+}
+}
 
-//this class represents a request for getting entities
-class EntitiesRequest: public Request
+static void signed8ToInt16(const int8_t* in, int16_t* out, size_t size)
 {
-public:
-EntitiesRequest():
-Request()
+for(size_t i=0; i<size; i++)
 {
-setHost(getHost()+"entities");
+out[i]=(int16_t)(in[i]*256);
+}
 }
 
-EntitiesResponce perform()
+static void unsigned8ToInt16(const uint8_t* in, int16_t* out, size_t size)
 {
-std::string s="";
-s+="?v="+param.getVersion();
+for(size_t i=0; i<size; i++)
+{
+out[i]=(int16_t)((in[i]-128)*256);
+}
+}
+
+//averages the left and right samples of interleaved stereo
+static void downmixStereo(const int16_t* in, int16_t* out, size_t frames)
+{
+size_t i=0;
+#if defined(WITPP_SSE2)
+for(; i+8<=frames; i+=8)
+{
+__m128i sums[2];
+for(int k=0; k<2; k++)
+{
+__m128i v=_mm_loadu_si128((const __m128i*)(in+2*i+8*k));
+//the left samples are the low halves of the 32 bit words, the right ones the high halves
+__m128i left=_mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+__m128i right=_mm_srai_epi32(v, 16);
+sums[k]=_mm_srai_epi32(_mm_add_epi32(left, right), 1);
+}
+_mm_storeu_si128((__m128i*)(out+i), _mm_packs_epi32(sums[0], sums[1]));
+}
+#elif defined(WITPP_NEON)
+for(; i+8<=frames; i+=8)
+{
+int16x8x2_t v=vld2q_s16(in+2*i);
+//halving add: (left+right)>>1 without overflow
+vst1q_s16(out+i, vhaddq_s16(v.val[0], v.val[1]));
+}
+#endif
+for(; i<frames; i++)
+{
+out[i]=(int16_t)((in[2*i]+in[2*i+1])>>1);
+}
+}
+
+//averages the channels of interleaved frames
+static void downmix(const int16_t* in, int16_t* out, size_t frames, int channels)
+{
+for(size_t i=0; i<frames; i++)
+{
+int32_t sum=0;
+for(int c=0; c<channels; c++)
+{
+sum+=in[i*channels+c];
+}
+out[i]=(int16_t)(sum/channels);
+}
+}
+
+};
+
+//this class receives the recorded audio. it keeps its buffer between the recordings, so once it has grown (or been reserved) the chunks are appended without allocating
+class AudioSink
+{
+std::vector<char> buffer;
+size_t size;
+public:
+AudioSink():
+size(0)
+{
+}
+
+//appends raw bytes
+void write(const void* data, size_t bytes)
+{
+if(size+bytes>buffer.size())
+{
+buffer.resize(std::max(size+bytes, buffer.size()*2));
+}
+std::memcpy(buffer.data()+size, data, bytes);
+size+=bytes;
+}
+
+//appends 16 bit samples as little endian
+void write(const int16_t* samples, size_t count)
+{
+size_t old_size=size;
+write((const void*)samples, count*2);
+if(SampleConverter::isHostBigEndian())
+{
+for(size_t i=old_size; i<size; i+=2)
+{
+std::swap(buffer[i], buffer[i+1]);
+}
+}
+}
+
+//makes room for bytes in total, so the recording doesn't allocate until it gets longer
+void reserve(size_t bytes)
+{
+if(bytes>buffer.size())
+{
+buffer.resize(bytes);
+}
+}
+
+//forgets the audio but keeps the buffer
+void clear()
+{
+size=0;
+}
+
+//exchanges the audio and the buffers of two sinks, without copying
+void swap(AudioSink& other)
+{
+buffer.swap(other.buffer);
+std::swap(size, other.size);
+}
+
+const char* getData() const
+{
+return buffer.data();
+}
+
+size_t getSize() const
+{
+return size;
+}
+
+size_t getCapacity() const
+{
+return buffer.size();
+}
+
+};
+
+//this class reads the samples that were written to a stream or a sink since the last read, as 16 bit signed mono samples
+class SampleStreamReader
+{
+SampleConverter converter;
+std::string pending;
+std::vector<int16_t> samples;
+size_t offset;
+public:
+//the format of the written samples (see SampleConverter)
+SampleStreamReader(BitsType bits=BIT_TYPE_16BIT, EndianType endian=LITTLE_ENDIAN, EncodingType encoding=SIGNED_INTEGER, int channels=1):
+converter(bits, endian, encoding, channels),
+offset(0)
+{
+}
+
+//returns the samples written to the sink since the last read, converted straight from its buffer. they stay valid until the next read
+const std::vector<int16_t>& read(const AudioSink& sink)
+{
+size_t frame_size=converter.getFrameSize();
+size_t frames=(sink.getSize()-offset)/frame_size;
+samples.clear();
+converter.convert(sink.getData()+offset, frames, samples);
+offset+=frames*frame_size;
+return samples;
+}
+
+//returns the new samples. they stay valid until the next read
+const std::vector<int16_t>& read(std::stringstream& stream)
+{
+char buf[4096];
+std::streamsize n;
+while((n=stream.rdbuf()->sgetn(buf, sizeof(buf)))>0)
+{
+pending.append(buf, n);
+}
+size_t frame_size=converter.getFrameSize();
+size_t frames=pending.size()/frame_size;
+samples.clear();
+converter.convert(pending.data(), frames, samples);
+pending.erase(0, frames*frame_size);
+return samples;
+}
+
+};
+
+//this class converts the sample rate of a stream of 16 bit samples by any ratio (e.g from a 44.1khz or 48khz capture to 16khz for the upload) with a polyphase windowed sinc filter
+//the output lags the input by getDelay() output samples. process the chunks as they come and flush() at the end. the dot products use SSE2 or NEON when the compiler targets them
+class Resampler
+{
+int up;
+int down;
+int taps;
+std::vector<float> coefs;
+std::vector<float> history;
+int phase;
+size_t position;
+
+static int gcd(int a, int b)
+{
+while(b!=0)
+{
+int t=a%b;
+a=b;
+b=t;
+}
+return a;
+}
+
+//the zeroth order modified bessel function, for the kaiser window
+static double bessel0(double x)
+{
+double sum=1, term=1;
+for(int k=1; k<32; k++)
+{
+term*=(x/(2*k))*(x/(2*k));
+sum+=term;
+}
+return sum;
+}
+public:
+//zero_crossings is the number of sinc lobes on each side of the filter: more gives a sharper cutoff for more work (16 keeps the aliasing under the 16 bits of the samples)
+Resampler(int in_rate, int out_rate, int zero_crossings=16)
+{
+if(in_rate<=0 || out_rate<=0 || zero_crossings<=0)
+{
+throw std::invalid_argument("invalid resampler rates");
+}
+int g=gcd(in_rate, out_rate);
+up=out_rate/g;
+down=in_rate/g;
+//the filter spans the same number of lobes of the lower of the two rates, rounded up to 8 taps per phase for the vector loop
+double ratio=std::min(1.0, (double)up/down);
+taps=(int)std::ceil(2*zero_crossings/ratio);
+taps=(taps+7)/8*8;
+//the cutoff sits a bit under the nyquist frequency of the lower rate, relative to the upsampled rate
+double cutoff=0.5*ratio*0.94/up;
+double beta=8.6;
+int length=taps*up;
+double center=(length-1)/2.0;
+coefs.resize(length);
+for(int p=0; p<up; p++)
+{
+for(int q=0; q<taps; q++)
+{
+//phase p pairs with the input taps-1-q samples before the current one
+int j=p+(taps-1-q)*up;
+double t=j-center;
+double x=2*cutoff*t;
+double sinc=(t==0)?1:std::sin(3.14159265358979323846*x)/(3.14159265358979323846*x);
+double r=t/(center+1);
+double window=bessel0(beta*std::sqrt(std::max(0.0, 1-r*r)))/bessel0(beta);
+coefs[p*taps+q]=(float)(2*cutoff*up*sinc*window);
+}
+}
+reset();
+}
+
+//forgets the past samples (e.g before a new recording)
+void reset()
+{
+history.assign(taps-1, 0.0f);
+phase=0;
+position=taps-1;
+}
+
+//resamples a chunk and appends the result to out. returns the number of appended samples
+size_t process(const int16_t* samples, size_t size, std::vector<int16_t>& out)
+{
+size_t old_size=out.size();
+out.reserve(old_size+size*up/down+1);
+size_t start=history.size();
+history.resize(start+size);
+for(size_t i=0; i<size; i++)
+{
+history[start+i]=samples[i];
+}
+while(position<history.size())
+{
+const float* c=coefs.data()+(size_t)phase*taps;
+const float* x=history.data()+position-(taps-1);
+//eight independent sums, two vectors of four, so every target adds in the same order
+float acc[8]={0, 0, 0, 0, 0, 0, 0, 0};
+#if defined(WITPP_SSE2)
+__m128 low=_mm_setzero_ps();
+__m128 high=_mm_setzero_ps();
+for(int q=0; q<taps; q+=8)
+{
+low=_mm_add_ps(low, _mm_mul_ps(_mm_loadu_ps(c+q), _mm_loadu_ps(x+q)));
+high=_mm_add_ps(high, _mm_mul_ps(_mm_loadu_ps(c+q+4), _mm_loadu_ps(x+q+4)));
+}
+_mm_storeu_ps(acc, low);
+_mm_storeu_ps(acc+4, high);
+#elif defined(WITPP_NEON)
+float32x4_t low=vdupq_n_f32(0.0f);
+float32x4_t high=vdupq_n_f32(0.0f);
+for(int q=0; q<taps; q+=8)
+{
+//not fused, as on the other targets
+low=vaddq_f32(low, vmulq_f32(vld1q_f32(c+q), vld1q_f32(x+q)));
+high=vaddq_f32(high, vmulq_f32(vld1q_f32(c+q+4), vld1q_f32(x+q+4)));
+}
+vst1q_f32(acc, low);
+vst1q_f32(acc+4, high);
+#else
+for(int q=0; q<taps; q+=8)
+{
+for(int k=0; k<8; k++)
+{
+acc[k]+=c[q+k]*x[q+k];
+}
+}
+#endif
+float sum=((acc[0]+acc[1])+(acc[2]+acc[3]))+((acc[4]+acc[5])+(acc[6]+acc[7]));
+sum=std::max(-32768.0f, std::min(32767.0f, sum));
+out.push_back((int16_t)std::lrint(sum));
+phase+=down;
+position+=phase/up;
+phase%=up;
+}
+//keep the taps-1 last samples for the next chunk
+size_t keep=taps-1;
+size_t drop=history.size()-keep;
+history.erase(history.begin(), history.begin()+drop);
+position-=drop;
+return out.size()-old_size;
+}
+
+//pushes the samples still held back by the filter delay out
+size_t flush(std::vector<int16_t>& out)
+{
+std::vector<int16_t> silence(taps/2, 0);
+return process(silence.data(), silence.size(), out);
+}
+
+//the delay of the filter in output samples: the center of the filter, which falls between two outputs for most ratios
+double getDelay() const
+{
+return ((double)taps*up-1)/2.0/down;
+}
+
+int getTapsPerPhase() const
+{
+return taps;
+}
+
+};
+
+//this class keeps the last samples of a stream in a fixed ring, overwriting the oldest ones. nothing allocates after the constructor
+class PreRollBuffer
+{
+std::vector<int16_t> samples;
+size_t head;
+size_t count;
+public:
+PreRollBuffer(size_t capacity):
+samples(capacity),
+head(0),
+count(0)
+{
+}
+
+void write(const int16_t* data, size_t size)
+{
+size_t capacity=samples.size();
+if(capacity==0)
+{
+return;
+}
+//only the last capacity samples can stay
+if(size>capacity)
+{
+data+=size-capacity;
+size=capacity;
+}
+size_t first=std::min(size, capacity-head);
+std::memcpy(samples.data()+head, data, first*sizeof(int16_t));
+std::memcpy(samples.data(), data+first, (size-first)*sizeof(int16_t));
+head=(head+size)%capacity;
+count=std::min(capacity, count+size);
+}
+
+//appends the newest last samples (at most size()) to out, oldest first, and empties the ring
+size_t flush(std::vector<int16_t>& out, size_t last)
+{
+size_t n=std::min(last, count);
+size_t capacity=samples.size();
+size_t start=(head+capacity-n)%capacity;
+size_t first=std::min(n, capacity-start);
+out.insert(out.end(), samples.begin()+start, samples.begin()+start+first);
+out.insert(out.end(), samples.begin(), samples.begin()+(n-first));
+clear();
+return n;
+}
+
+void clear()
+{
+head=0;
+count=0;
+}
+
+size_t size() const
+{
+return count;
+}
+
+size_t getCapacity() const
+{
+return samples.size();
+}
+
+};
+
+#ifdef VAD_ENABLED
+
+class VoiceActivityDetector
+{
+wvs_state* state;
+public:
+//creates the detector the older versions made: WVS_ENERGY_DBFS_MEAN frames, which the other constructors (through wvs_default_params) measure as WVS_ENERGY_POWER
+VoiceActivityDetector(int sample_rate)
+{
+state=wvs_init(0, sample_rate);
+}
+
+//creates the detector with the given engine: WVS_ENGINE_ENERGY (the default) or WVS_ENGINE_SPECTRAL, which triggers much less on hum, fans and music
+VoiceActivityDetector(int sample_rate, wvs_engine engine)
+{
+wvs_params params;
+wvs_default_params(&params);
+params.engine=engine;
+state=wvs_init_params(&params, sample_rate);
+if(state==nullptr)
+{
+throw std::invalid_argument("invalid voice activity detector parameters");
+}
+}
+
+//creates the detector with your own tuning (start from wvs_default_params). throws std::invalid_argument if a parameter is out of range
+VoiceActivityDetector(int sample_rate, const wvs_params& params)
+{
+state=wvs_init_params(&params, sample_rate);
+if(state==nullptr)
+{
+throw std::invalid_argument("invalid voice activity detector parameters");
+}
+}
+
+~VoiceActivityDetector()
+{
+wvs_clean(state);
+}
+
+//chooses how the energy of the frames is measured. WVS_ENERGY_DBFS_MEAN gives the same decisions as the older versions
+VoiceActivityDetector& setEnergyMode(wvs_energy_mode mode)
+{
+wvs_set_energy_mode(state, mode);
+return *this;
+}
+
+bool talking(int16_t* samples, int size)
+{
+if(wvs_still_talking(state, samples, size)==1)
+{
+return true;
+}
+return false;
+}
+
+//feeds a chunk and appends the speech starts and ends it revealed to events. their offsets are absolute sample offsets in the stream, so you can cut the exact utterances
+//returns the number of appended events
+int process(const int16_t* samples, int size, std::vector<wvs_event>& events)
+{
+size_t old_size=events.size();
+int max_events=size/state->samples_per_frame+1;
+events.resize(old_size+max_events);
+int count=wvs_process(state, samples, size, events.data()+old_size, max_events);
+events.resize(old_size+count);
+return count;
+}
+
+//returns the number of samples fed since the detector was created
+int64_t getOffset() const
+{
+return state->stream_offset;
+}
+
+//the number of samples the detector decides on at a time
+int getFrameSize() const
+{
+return state->samples_per_frame;
+}
+
+bool isTalking() const
+{
+return state->talking!=0;
+}
+
+};
+
+//this class detects the voice activity of many channels (e.g call legs) at once. give it one frame (getFrameSize() samples per channel) of interleaved samples at a time
+class BatchVoiceActivityDetector
+{
+wvs_batch* batch;
+BatchVoiceActivityDetector(const BatchVoiceActivityDetector&);
+BatchVoiceActivityDetector& operator=(const BatchVoiceActivityDetector&);
+public:
+BatchVoiceActivityDetector(int channels, int sample_rate)
+{
+batch=wvs_batch_init(channels, 0, sample_rate);
+if(batch==nullptr)
+{
+throw std::bad_alloc();
+}
+}
+
+//creates the detector with your own tuning (start from wvs_default_params). throws std::invalid_argument if a parameter is out of range
+BatchVoiceActivityDetector(int channels, int sample_rate, const wvs_params& params)
+{
+batch=wvs_batch_init_params(channels, &params, sample_rate);
+if(batch==nullptr)
+{
+throw std::invalid_argument("invalid voice activity detector parameters");
+}
+}
+
+~BatchVoiceActivityDetector()
+{
+wvs_batch_clean(batch);
+}
+
+int getChannels() const
+{
+return batch->nb_channels;
+}
+
+int getFrameSize() const
+{
+return batch->samples_per_frame;
+}
+
+//processes one frame of all the channels (samples[i*getChannels()+channel]) and returns the number of talking channels
+int process(const int16_t* samples)
+{
+return wvs_batch_process(batch, samples);
+}
+
+bool talking(int channel) const
+{
+return (batch->talking[channel/32]>>(channel%32))&1;
+}
+
+//the talking bitmap: channel c is bit (c%32) of word c/32
+const uint32_t* getTalkingBitmap() const
+{
+return batch->talking;
+}
+
+//starts a channel over (e.g when a new call begins on it)
+BatchVoiceActivityDetector& resetChannel(int channel)
+{
+wvs_batch_reset_channel(batch, channel);
+return *this;
+}
+
+};
+
+//this class tells when an utterance is over: once the given trailing silence follows the speech, or once the recording (counted from its first sample, silence included) gets longer than the limit (0 for no limit)
+class Endpointer
+{
+VoiceActivityDetector detector;
+int64_t trailing_silence;
+int64_t max_length;
+int64_t speech_end;
+bool heard_speech;
+bool done;
+std::vector<wvs_event> events;
+SampleStreamReader reader;
+Endpointer(const Endpointer&);
+Endpointer& operator=(const Endpointer&);
+public:
+Endpointer(int sample_rate, int trailing_silence_ms, int max_recording_ms, const wvs_params& params):
+detector(sample_rate, params),
+trailing_silence((int64_t)sample_rate*trailing_silence_ms/1000),
+max_length((int64_t)sample_rate*max_recording_ms/1000),
+speech_end(-1),
+heard_speech(false),
+done(false)
+{
+}
+
+//feeds a chunk and returns true when the utterance is over
+bool process(const int16_t* chunk, int size)
+{
+if(done)
+{
+return true;
+}
+events.clear();
+detector.process(chunk, size, events);
+for(size_t i=0; i<events.size(); i++)
+{
+if(events[i].type==WVS_SPEECH_START)
+{
+heard_speech=true;
+speech_end=-1;
+}
+else
+{
+speech_end=events[i].offset;
+}
+}
+if(heard_speech && speech_end>=0 && !detector.isTalking() && detector.getOffset()-speech_end>=trailing_silence)
+{
+done=true;
+}
+if(max_length>0 && detector.getOffset()>=max_length)
+{
+done=true;
+}
+return done;
+}
+
+//feeds what has been written to the stream since the last call, as 16 bit little endian samples
+bool process(std::stringstream& stream)
+{
+const std::vector<int16_t>& samples=reader.read(stream);
+return process(samples.data(), samples.size());
+}
+
+bool heardSpeech() const
+{
+return heard_speech;
+}
+
+bool isDone() const
+{
+return done;
+}
+
+//returns the number of samples the recording is limited to (0 for no limit)
+int64_t getMaxLength() const
+{
+return max_length;
+}
+
+};
+
+//this class holds a recording back until the voice detector hears speech, so the silence before it isn't uploaded
+//the detector needs onset_frames of speech to be sure, so the last pre_roll_ms before the start of the speech are kept in a ring and let out with it: the first word isn't clipped
+class SpeechGate
+{
+VoiceActivityDetector detector;
+PreRollBuffer ring;
+int64_t pre_roll;
+bool open;
+std::vector<wvs_event> events;
+SpeechGate(const SpeechGate&);
+SpeechGate& operator=(const SpeechGate&);
+public:
+SpeechGate(int sample_rate, int pre_roll_ms, const wvs_params& params):
+detector(sample_rate, params),
+//a chunk that ends inside a frame leaves up to a frame more behind the start than the onset window, hence the extra frame
+ring((size_t)((int64_t)sample_rate*(pre_roll_ms+params.onset_frames*params.frame_ms)/1000+detector.getFrameSize())),
+pre_roll((int64_t)sample_rate*pre_roll_ms/1000),
+open(false)
+{
+}
+
+//feeds a chunk and appends what is to be uploaded to out: nothing until the speech starts, then the pre-roll and everything after it
+//returns the number of appended samples
+size_t process(const int16_t* samples, size_t size, std::vector<int16_t>& out)
+{
+size_t old_size=out.size();
+size_t frame=detector.getFrameSize();
+size_t i=0;
+//one frame at a time, so the ring holds the onset whatever the size of the chunks
+while(!open && i<size)
+{
+size_t n=std::min(frame, size-i);
+ring.write(samples+i, n);
+events.clear();
+detector.process(samples+i, (int)n, events);
+i+=n;
+for(size_t e=0; e<events.size(); e++)
+{
+if(events[e].type==WVS_SPEECH_START)
+{
+int64_t from=std::max((int64_t)0, events[e].offset-pre_roll);
+ring.flush(out, (size_t)(detector.getOffset()-from));
+open=true;
+break;
+}
+}
+}
+out.insert(out.end(), samples+i, samples+size);
+return out.size()-old_size;
+}
+
+bool isOpen() const
+{
+return open;
+}
+
+};
+
+//a part of a recording: the samples from start to end (excluded)
+struct AudioSegment
+{
+int64_t start;
+int64_t end;
+};
+
+//this class splits a long recording (e.g a voicemail or a meeting) at its silences into segments that can be recognised one by one
+//the speech the voice detector finds gets padding_ms on both sides, and the parts less than max_gap_ms apart are put together as long as they fit in max_segment_ms. speech longer than that is cut at its quietest frame
+class Segmenter
+{
+int sample_rate;
+int64_t max_length;
+int64_t padding;
+int64_t max_gap;
+wvs_params params;
+
+//the offset of the quietest frame between from and to
+int64_t quietest(const int16_t* samples, int64_t from, int64_t to, int64_t frame) const
+{
+int64_t best=to;
+double best_energy=-1;
+for(int64_t f=from; f+frame<=to; f+=frame)
+{
+double energy=0;
+for(int64_t i=f; i<f+frame; i++)
+{
+energy+=(double)samples[i]*samples[i];
+}
+if(best_energy<0 || energy<best_energy)
+{
+best_energy=energy;
+best=f+frame/2;
+}
+}
+return best;
+}
+
+public:
+Segmenter(int sample_rate, int max_segment_ms):
+sample_rate(sample_rate),
+max_length((int64_t)sample_rate*max_segment_ms/1000),
+padding((int64_t)sample_rate/4),
+max_gap((int64_t)sample_rate)
+{
+wvs_default_params(&params);
+if(max_length<=0)
+{
+throw std::invalid_argument("invalid segment length");
+}
+}
+
+Segmenter(int sample_rate, int max_segment_ms, int padding_ms, int max_gap_ms, const wvs_params& params):
+sample_rate(sample_rate),
+max_length((int64_t)sample_rate*max_segment_ms/1000),
+padding((int64_t)sample_rate*padding_ms/1000),
+max_gap((int64_t)sample_rate*max_gap_ms/1000),
+params(params)
+{
+if(max_length<=0)
+{
+throw std::invalid_argument("invalid segment length");
+}
+}
+
+//returns the segments of the recording, in order. throws std::invalid_argument if the detector parameters are out of range
+std::vector<AudioSegment> split(const int16_t* samples, size_t size) const
+{
+VoiceActivityDetector detector(sample_rate, params);
+std::vector<wvs_event> events;
+//the detector takes an int count: a long recording is fed a part at a time
+const size_t part=(size_t)1<<24;
+for(size_t done=0; done<size; done+=part)
+{
+detector.process(samples+done, (int)std::min(part, size-done), events);
+}
+//the speech, padded
+std::vector<AudioSegment> speech;
+AudioSegment current={0, 0};
+bool talking=false;
+for(size_t i=0; i<events.size(); i++)
+{
+if(events[i].type==WVS_SPEECH_START)
+{
+current.start=events[i].offset;
+talking=true;
+}
+else if(talking)
+{
+current.end=events[i].offset;
+speech.push_back(current);
+talking=false;
+}
+}
+//the recording ends on speech
+if(talking)
+{
+current.end=size;
+speech.push_back(current);
+}
+std::vector<AudioSegment> segments;
+int64_t frame=std::max(detector.getFrameSize(), 1);
+for(size_t i=0; i<speech.size(); i++)
+{
+int64_t start=std::max((int64_t)0, speech[i].start-padding);
+int64_t end=std::min((int64_t)size, speech[i].end+padding);
+if(!segments.empty())
+{
+AudioSegment& last=segments.back();
+if(start<=last.end+max_gap && end-last.start<=max_length)
+{
+last.end=end;
+continue;
+}
+//the padding doesn't overlap the previous segment
+start=std::max(start, last.end);
+}
+//too long to be sent at once: cut in the quieter second half of the limit
+while(end-start>max_length)
+{
+int64_t cut=quietest(samples, start+max_length/2, start+max_length, frame);
+AudioSegment part={start, cut};
+segments.push_back(part);
+start=cut;
+}
+AudioSegment segment={start, end};
+segments.push_back(segment);
+}
+return segments;
+}
+
+};
+
+#endif //VAD_ENABLED
+
+//this class runs the recorded audio through the format conversion, the resampler, the endpointer and the G.711 encoder, and gives what is to be uploaded: 16 bit signed little endian mono samples, or G.711
+class VoiceProcessor
+{
+SampleConverter converter;
+std::string pending;
+std::vector<int16_t> converted;
+std::vector<int16_t> resampled;
+std::unique_ptr<Resampler> resampler;
+#ifdef VAD_ENABLED
+std::unique_ptr<Endpointer> endpointer;
+std::unique_ptr<SpeechGate> gate;
+std::vector<int16_t> gated;
+#endif //VAD_ENABLED
+bool transcoding;
+EncodingType transcoding_type;
+size_t max_samples;
+size_t samples_out;
+bool done;
+VoiceProcessor(const VoiceProcessor&);
+VoiceProcessor& operator=(const VoiceProcessor&);
+public:
+//the format and rate of the recording, the rate of the upload and the G.711 law to encode with (if transcoding)
+VoiceProcessor(BitsType bits, EndianType endian, EncodingType encoding, int channels, int input_rate, int output_rate, bool transcoding, EncodingType transcoding_type):
+converter(bits, endian, encoding, channels),
+transcoding(transcoding),
+transcoding_type(transcoding_type),
+max_samples(0),
+samples_out(0),
+done(false)
+{
+if(input_rate>0 && input_rate!=output_rate)
+{
+resampler.reset(new Resampler(input_rate, output_rate));
+}
+}
+
+#ifdef VAD_ENABLED
+//stops the recording once the trailing silence follows the speech or the length limit is reached (see Endpointer)
+void setEndpointing(int sample_rate, int trailing_silence_ms, int max_recording_ms, const wvs_params& params)
+{
+endpointer.reset(new Endpointer(sample_rate, trailing_silence_ms, max_recording_ms, params));
+max_samples=endpointer->getMaxLength();
+}
+
+//uploads nothing until the speech starts, then the last pre_roll_ms before it and the rest of the recording (see SpeechGate)
+void setGating(int sample_rate, int pre_roll_ms, const wvs_params& params)
+{
+gate.reset(new SpeechGate(sample_rate, pre_roll_ms, params));
+}
+#endif //VAD_ENABLED
+
+//processes a chunk of recorded bytes (a partial frame is kept for the next one) and appends the result to out. last lets the samples held back by the resampler out
+//returns true once the recording should stop: the endpointer heard the end of the utterance or the length limit was reached
+bool process(const char* data, size_t size, bool last, std::string& out)
+{
+if(done)
+{
+return true;
+}
+converted.clear();
+size_t frame_size=converter.getFrameSize();
+if(!pending.empty())
+{
+size_t take=std::min(frame_size-pending.size(), size);
+pending.append(data, take);
+data+=take;
+size-=take;
+if(pending.size()==frame_size)
+{
+converter.convert(pending.data(), 1, converted);
+pending.clear();
+}
+}
+size_t frames=size/frame_size;
+converter.convert(data, frames, converted);
+pending.append(data+frames*frame_size, size-frames*frame_size);
+const std::vector<int16_t>* samples=&converted;
+if(resampler)
+{
+resampled.clear();
+resampler->process(samples->data(), samples->size(), resampled);
+//the recording is over, so the samples held back by the filter are let out
+if(last)
+{
+resampler->flush(resampled);
+}
+samples=&resampled;
+}
+#ifdef VAD_ENABLED
+if(endpointer && !last && endpointer->process(samples->data(), samples->size()))
+{
+done=true;
+}
+//the endpointer hears the whole recording, the gate only holds the upload back
+if(gate)
+{
+gated.clear();
+gate->process(samples->data(), samples->size(), gated);
+samples=&gated;
+}
+#endif //VAD_ENABLED
+size_t count=samples->size();
+//the chunk that runs past the limit gets cut
+if(max_samples>0 && samples_out+count>=max_samples)
+{
+count=max_samples-samples_out;
+done=true;
+}
+samples_out+=count;
+size_t old_size=out.size();
+if(transcoding)
+{
+out.resize(old_size+count);
+if(transcoding_type==MU_LAW)
+{
+G711::encodeMuLaw(samples->data(), (uint8_t*)&out[old_size], count);
+}
+else
+{
+G711::encodeALaw(samples->data(), (uint8_t*)&out[old_size], count);
+}
+}
+else
+{
+out.resize(old_size+count*2);
+for(size_t i=0; i<count; i++)
+{
+out[old_size+2*i]=(char)((*samples)[i]&0xff);
+out[old_size+2*i+1]=(char)(((*samples)[i]>>8)&0xff);
+}
+}
+return done;
+}
+
+};
+
+typedef enum {
+RECORDING_STARTED,
+RECORDING_CONTINUE,
+RECORDING_STOPPED
+}RecordingStatus;
+
+typedef std::function<RecordingStatus (std::stringstream&)> SourceFunction;
+
+//a source that appends its chunks to a sink instead of a stream
+typedef std::function<RecordingStatus (AudioSink&)> ChunkSourceFunction;
+
+//this class is a lock free ring of samples between one producer (e.g the realtime capture thread) and one consumer (e.g the uploader or the voice detector). nothing blocks or allocates after the constructor
+class AudioRingBuffer
+{
+std::vector<int16_t> buffer;
+size_t mask;
+//the producer and the consumer indices live on their own cache lines
+char pad0[64];
+std::atomic<size_t> head;
+char pad1[64];
+std::atomic<size_t> tail;
+char pad2[64];
+std::atomic<size_t> dropped;
+std::atomic<bool> closed;
+AudioRingBuffer(const AudioRingBuffer&);
+AudioRingBuffer& operator=(const AudioRingBuffer&);
+public:
+//capacity is in samples and gets rounded up to a power of two
+AudioRingBuffer(size_t capacity):
+head(0),
+tail(0),
+dropped(0),
+closed(false)
+{
+size_t size=1;
+while(size<capacity)
+{
+size<<=1;
+}
+buffer.resize(size);
+mask=size-1;
+}
+
+//producer: writes the whole frame, or nothing if it doesn't fit (the frame is counted as dropped)
+bool push(const int16_t* samples, size_t size)
+{
+size_t h=head.load(std::memory_order_relaxed);
+size_t t=tail.load(std::memory_order_acquire);
+if(buffer.size()-(h-t)<size)
+{
+dropped.fetch_add(1, std::memory_order_relaxed);
+return false;
+}
+size_t start=h&mask;
+size_t first=std::min(size, buffer.size()-start);
+std::copy(samples, samples+first, buffer.data()+start);
+std::copy(samples+first, samples+size, buffer.data());
+head.store(h+size, std::memory_order_release);
+return true;
+}
+
+//producer: tells the consumer that no more samples will come
+void close()
+{
+closed.store(true, std::memory_order_release);
+}
+
+//consumer: reads up to size samples and returns how many were read
+size_t pop(int16_t* samples, size_t size)
+{
+size_t t=tail.load(std::memory_order_relaxed);
+size_t h=head.load(std::memory_order_acquire);
+size_t count=std::min(size, h-t);
+size_t start=t&mask;
+size_t first=std::min(count, buffer.size()-start);
+std::copy(buffer.data()+start, buffer.data()+start+first, samples);
+std::copy(buffer.data(), buffer.data()+count-first, samples+first);
+tail.store(t+count, std::memory_order_release);
+return count;
+}
+
+//the number of samples waiting for the consumer
+size_t available() const
+{
+return head.load(std::memory_order_acquire)-tail.load(std::memory_order_acquire);
+}
+
+size_t getCapacity() const
+{
+return buffer.size();
+}
+
+//the number of frames the producer couldn't push because the consumer was behind
+size_t getDropped() const
+{
+return dropped.load(std::memory_order_relaxed);
+}
+
+bool isClosed() const
+{
+return closed.load(std::memory_order_acquire);
+}
+
+};
+
+//this class hands audio from a producer thread to the request, which sleeps until the producer writes or closes: an idle recording doesn't use the cpu, and the audio is taken as soon as it's written
+//the writes take a lock, so a realtime capture thread should use an AudioRingBuffer instead
+class AudioChannel
+{
+std::mutex mutex;
+std::condition_variable ready;
+std::condition_variable room;
+AudioSink pending;
+AudioSink taken;
+size_t max_bytes;
+bool closed;
+AudioChannel(const AudioChannel&);
+AudioChannel& operator=(const AudioChannel&);
+
+//waits until bytes more fit under the limit (a write bigger than the limit goes in once the channel is empty). returns false if the channel got closed
+bool waitRoom(std::unique_lock<std::mutex>& lock, size_t bytes)
+{
+room.wait(lock, [this, bytes]() { return closed || max_bytes==0 || pending.getSize()==0 || pending.getSize()+bytes<=max_bytes; });
+return !closed;
+}
+
+public:
+//max_bytes is the most audio that waits for the consumer: a write that doesn't fit waits until the consumer reads, so a slow upload holds the producer back (as the queues of a pipelined request do). 0 for no limit
+AudioChannel(size_t max_bytes=0):
+max_bytes(max_bytes),
+closed(false)
+{
+}
+
+//producer: appends raw bytes, waiting for room if the channel is full. returns false once the channel is closed (the recording is over)
+bool write(const void* data, size_t bytes)
+{
+{
+std::unique_lock<std::mutex> lock(mutex);
+if(!waitRoom(lock, bytes))
+{
+return false;
+}
+pending.write(data, bytes);
+}
+ready.notify_one();
+return true;
+}
+
+//producer: appends 16 bit samples as little endian, waiting for room if the channel is full. returns false once the channel is closed
+bool write(const int16_t* samples, size_t count)
+{
+{
+std::unique_lock<std::mutex> lock(mutex);
+if(!waitRoom(lock, count*2))
+{
+return false;
+}
+pending.write(samples, count);
+}
+ready.notify_one();
+return true;
+}
+
+//tells the consumer that no more audio will come. the audio written before is still read
+void close()
+{
+{
+std::lock_guard<std::mutex> lock(mutex);
+closed=true;
+}
+ready.notify_all();
+room.notify_all();
+}
+
+//opens the channel again, empty, for the next recording
+void reset()
+{
+std::lock_guard<std::mutex> lock(mutex);
+pending.clear();
+closed=false;
+}
+
+bool isClosed()
+{
+std::lock_guard<std::mutex> lock(mutex);
+return closed;
+}
+
+//consumer: sleeps until there is audio or the channel is closed, and appends the audio to out
+//returns RECORDING_STOPPED once the channel is closed and everything was read
+RecordingStatus read(AudioSink& out)
+{
+bool stopped;
+{
+std::unique_lock<std::mutex> lock(mutex);
+ready.wait(lock, [this]() { return pending.getSize()>0 || closed; });
+//the buffers are swapped, so the copy to out is done without the lock
+taken.swap(pending);
+stopped=closed;
+}
+room.notify_all();
+out.write((const void*)taken.getData(), taken.getSize());
+taken.clear();
+return stopped?RECORDING_STOPPED:RECORDING_CONTINUE;
+}
+
+};
+
+//this class is a bounded lock free queue between one producer thread and one consumer thread. the items are swapped in and out, so their buffers can go back and forth without being reallocated
+template<typename T>
+class SpscQueue
+{
+std::vector<T> slots;
+size_t mask;
+char pad0[64];
+std::atomic<size_t> head;
+char pad1[64];
+std::atomic<size_t> tail;
+char pad2[64];
+SpscQueue(const SpscQueue&);
+SpscQueue& operator=(const SpscQueue&);
+public:
+//capacity is rounded up to a power of two
+SpscQueue(size_t capacity):
+head(0),
+tail(0)
+{
+size_t size=1;
+while(size<capacity)
+{
+size<<=1;
+}
+slots.resize(size);
+mask=size-1;
+}
+
+//producer: swaps item into the queue. returns false if it's full
+bool push(T& item)
+{
+size_t h=head.load(std::memory_order_relaxed);
+if(h-tail.load(std::memory_order_acquire)==slots.size())
+{
+return false;
+}
+std::swap(slots[h&mask], item);
+head.store(h+1, std::memory_order_release);
+return true;
+}
+
+//consumer: swaps the oldest item out of the queue. returns false if it's empty
+bool pop(T& item)
+{
+size_t t=tail.load(std::memory_order_relaxed);
+if(head.load(std::memory_order_acquire)==t)
+{
+return false;
+}
+std::swap(item, slots[t&mask]);
+tail.store(t+1, std::memory_order_release);
+return true;
+}
+
+size_t size() const
+{
+return head.load(std::memory_order_acquire)-tail.load(std::memory_order_acquire);
+}
+
+size_t getCapacity() const
+{
+return slots.size();
+}
+
+};
+
+//the counters of a stage of the pipelined VoiceRequest
+struct PipelineStageStats
+{
+uint64_t chunks;
+//the time spent on the chunks, and on the slowest one
+double busy_ms;
+double max_chunk_ms;
+//the time spent waiting for room in the next queue (the backpressure), or for chunks to upload
+double waiting_ms;
+//the most chunks that waited in front of the stage
+size_t max_queue_depth;
+};
+
+struct PipelineStats
+{
+PipelineStageStats capture;
+PipelineStageStats process;
+PipelineStageStats upload;
+//from the capture of a chunk to its upload
+double mean_latency_ms;
+double max_latency_ms;
+};
+
+//this class runs a recording on three stages: the capture (the source) and the processing (a VoiceProcessor) have their own threads, and the upload is curl reading the chunks as they come on the thread of perform
+//the stages are joined by bounded lock free queues, so a slow stage holds the ones before it back, down to the source. a stage that waits for its queue sleeps until the queue changes, so an idle pipeline doesn't use the cpu
+class VoicePipeline
+{
+typedef std::chrono::steady_clock Clock;
+struct Chunk
+{
+std::string data;
+Clock::time_point captured;
+bool last;
+Chunk():
+last(false)
+{
+}
+};
+ChunkSourceFunction source;
+VoiceProcessor* processor;
+SpscQueue<Chunk> captured;
+SpscQueue<Chunk> captured_free;
+SpscQueue<Chunk> processed;
+SpscQueue<Chunk> processed_free;
+std::atomic<bool> stopping;
+std::atomic<bool> aborting;
+std::mutex mutex;
+std::condition_variable changed;
+std::exception_ptr capture_error;
+std::exception_ptr process_error;
+std::thread capture_thread;
+std::thread process_thread;
+Chunk current;
+size_t current_offset;
+bool finished;
+bool current_counted;
+double latency_sum_ms;
+PipelineStats stats;
+VoicePipeline(const VoicePipeline&);
+VoicePipeline& operator=(const VoicePipeline&);
+
+static double elapsed(Clock::time_point since)
+{
+return std::chrono::duration<double, std::milli>(Clock::now()-since).count();
+}
+
+//sleeps until ready() or the abort. the queues stay lock free, the lock only makes sure a wake up isn't missed
+template<typename Ready> void waitFor(Ready ready)
+{
+std::unique_lock<std::mutex> lock(mutex);
+changed.wait(lock, [&]() { return ready() || aborting.load(std::memory_order_acquire); });
+}
+
+//wakes the stages up after a queue changed
+void notify()
+{
+{
+std::lock_guard<std::mutex> lock(mutex);
+}
+changed.notify_all();
+}
+
+//waits for room in the queue, unless the upload is gone
+bool pushWait(SpscQueue<Chunk>& queue, Chunk& chunk, PipelineStageStats& stage)
+{
+if(aborting.load(std::memory_order_acquire))
+{
+return false;
+}
+if(!queue.push(chunk))
+{
+Clock::time_point start=Clock::now();
+waitFor([&]() { return queue.size()<queue.getCapacity(); });
+if(!queue.push(chunk))
+{
+return false;
+}
+stage.waiting_ms+=elapsed(start);
+}
+notify();
+return true;
+}
+
+static void record(PipelineStageStats& stage, Clock::time_point start)
+{
+double ms=elapsed(start);
+stage.chunks++;
+stage.busy_ms+=ms;
+stage.max_chunk_ms=std::max(stage.max_chunk_ms, ms);
+}
+
+void capture()
+{
+AudioSink sink;
+Chunk chunk;
+bool last=false;
+while(!last)
+{
+//the upload is over (or failed), so nothing more is recorded
+if(aborting.load(std::memory_order_acquire))
+{
+return;
+}
+captured_free.pop(chunk);
+if(stopping.load(std::memory_order_acquire))
+{
+//the processing asked for the end, so the source isn't called anymore
+chunk.data.clear();
+last=true;
+}
+else
+{
+Clock::time_point start=Clock::now();
+try
+{
+sink.clear();
+last=source(sink)==RECORDING_STOPPED;
+chunk.data.assign(sink.getData(), sink.getSize());
+}
+catch(...)
+{
+capture_error=std::current_exception();
+chunk.data.clear();
+last=true;
+}
+chunk.captured=start;
+record(stats.capture, start);
+}
+chunk.last=last;
+if(!pushWait(captured, chunk, stats.capture))
+{
+return;
+}
+}
+}
+
+void process()
+{
+Chunk in;
+Chunk out;
+bool last=false;
+bool done=false;
+while(!last)
+{
+waitFor([&]() { return captured.size()>0; });
+if(aborting.load(std::memory_order_acquire))
+{
+return;
+}
+stats.process.max_queue_depth=std::max(stats.process.max_queue_depth, captured.size());
+captured.pop(in);
+notify();
+last=in.last;
+if(done)
+{
+//the chunks the capture sent before it heard of the end are dropped
+captured_free.push(in);
+continue;
+}
+Clock::time_point start=Clock::now();
+processed_free.pop(out);
+out.data.clear();
+if(processor==nullptr)
+{
+std::swap(out.data, in.data);
+}
+else
+{
+try
+{
+done=processor->process(in.data.data(), in.data.size(), last, out.data);
+}
+catch(...)
+{
+process_error=std::current_exception();
+done=true;
+}
+if(done)
+{
+stopping.store(true, std::memory_order_release);
+}
+}
+out.captured=in.captured;
+out.last=last || done;
+captured_free.push(in);
+record(stats.process, start);
+if(!pushWait(processed, out, stats.process))
+{
+return;
+}
+}
+}
+
+public:
+//queue_chunks is the number of chunks each queue holds. processor may be nullptr to upload the recording as it is
+VoicePipeline(ChunkSourceFunction source, VoiceProcessor* processor, size_t queue_chunks):
+source(source),
+processor(processor),
+captured(queue_chunks),
+captured_free(queue_chunks),
+processed(queue_chunks),
+processed_free(queue_chunks),
+stopping(false),
+aborting(false),
+current_offset(0),
+finished(false),
+current_counted(true),
+latency_sum_ms(0)
+{
+std::memset(&stats, 0, sizeof(stats));
+}
+
+~VoicePipeline()
+{
+aborting.store(true, std::memory_order_release);
+notify();
+if(capture_thread.joinable())
+{
+capture_thread.join();
+}
+if(process_thread.joinable())
+{
+process_thread.join();
+}
+}
+
+void start()
+{
+capture_thread=std::thread(&VoicePipeline::capture, this);
+process_thread=std::thread(&VoicePipeline::process, this);
+}
+
+//gives the upload up to size bytes, waiting for them if needed. returns 0 at the end of the recording
+size_t read(char* buf, size_t size)
+{
+size_t written=0;
+while(written==0 && !finished)
+{
+if(current_offset==current.data.size())
+{
+if(current.last && current_counted)
+{
+finished=true;
+break;
+}
+if(processed.size()==0)
+{
+Clock::time_point start=Clock::now();
+waitFor([&]() { return processed.size()>0; });
+stats.upload.waiting_ms+=elapsed(start);
+}
+//only an abort leaves it empty
+if(processed.size()==0)
+{
+finished=true;
+break;
+}
+stats.upload.max_queue_depth=std::max(stats.upload.max_queue_depth, processed.size());
+processed_free.push(current);
+processed.pop(current);
+notify();
+current_offset=0;
+current_counted=false;
+}
+if(!current_counted)
+{
+double latency=elapsed(current.captured);
+stats.upload.chunks++;
+latency_sum_ms+=latency;
+stats.max_latency_ms=std::max(stats.max_latency_ms, latency);
+current_counted=true;
+}
+Clock::time_point start=Clock::now();
+size_t n=std::min(size, current.data.size()-current_offset);
+std::memcpy(buf, current.data.data()+current_offset, n);
+current_offset+=n;
+written=n;
+stats.upload.busy_ms+=elapsed(start);
+}
+return written;
+}
+
+//stops and joins the threads, and throws what the source or the processing threw
+void finish()
+{
+aborting.store(true, std::memory_order_release);
+notify();
+capture_thread.join();
+process_thread.join();
+stats.mean_latency_ms=stats.upload.chunks>0?latency_sum_ms/stats.upload.chunks:0;
+if(capture_error)
+{
+std::rethrow_exception(capture_error);
+}
+if(process_error)
+{
+std::rethrow_exception(process_error);
+}
+}
+
+const PipelineStats& getStats() const
+{
+return stats;
+}
+
+//the read callback of curl
+static size_t readcb(char* buf, size_t sz, size_t items, void* p)
+{
+return static_cast<VoicePipeline*>(p)->read(buf, sz*items);
+}
+
+};
+
+#ifdef WITPP_HAVE_MMAP
+//this class maps a wav or a raw pcm file into memory, so its samples can be uploaded without being copied
+class MappedAudioFile
+{
+void* map;
+size_t map_size;
+const char* data;
+size_t size;
+int rate;
+BitsType bits;
+EndianType endian;
+EncodingType encoding;
+int channels;
+MappedAudioFile(const MappedAudioFile&);
+MappedAudioFile& operator=(const MappedAudioFile&);
+
+void open(const std::string& path)
+{
+int fd=::open(path.c_str(), O_RDONLY);
+if(fd<0)
+{
+throw std::runtime_error("can't open "+path);
+}
+struct stat st;
+if(fstat(fd, &st)!=0)
+{
+::close(fd);
+throw std::runtime_error("can't stat "+path);
+}
+map_size=st.st_size;
+if(map_size>0)
+{
+map=mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+if(map==MAP_FAILED)
+{
+map=nullptr;
+::close(fd);
+throw std::runtime_error("can't map "+path);
+}
+madvise(map, map_size, MADV_SEQUENTIAL);
+}
+::close(fd);
+data=(const char*)map;
+size=map_size;
+}
+
+uint32_t read32(const char* p, bool big) const
+{
+const uint8_t* b=(const uint8_t*)p;
+if(big)
+{
+return ((uint32_t)b[0]<<24)|((uint32_t)b[1]<<16)|((uint32_t)b[2]<<8)|b[3];
+}
+return ((uint32_t)b[3]<<24)|((uint32_t)b[2]<<16)|((uint32_t)b[1]<<8)|b[0];
+}
+
+uint16_t read16(const char* p, bool big) const
+{
+const uint8_t* b=(const uint8_t*)p;
+return big?(uint16_t)((b[0]<<8)|b[1]):(uint16_t)((b[1]<<8)|b[0]);
+}
+
+void parseWav()
+{
+const char* base=(const char*)map;
+if(map_size<12 || (std::memcmp(base, "RIFF", 4)!=0 && std::memcmp(base, "RIFX", 4)!=0) || std::memcmp(base+8, "WAVE", 4)!=0)
+{
+throw std::runtime_error("not a wav file");
+}
+bool big=base[3]=='X';
+endian=big?BIG_ENDIAN:LITTLE_ENDIAN;
+bool have_format=false;
+size_t pos=12;
+while(pos+8<=map_size)
+{
+uint32_t chunk_size=read32(base+pos+4, big);
+const char* chunk=base+pos+8;
+size_t available=map_size-pos-8;
+if(std::memcmp(base+pos, "fmt ", 4)==0 && chunk_size>=16 && available>=16)
+{
+uint16_t tag=read16(chunk, big);
+channels=read16(chunk+2, big);
+rate=read32(chunk+4, big);
+uint16_t sample_bits=read16(chunk+14, big);
+//the extensible format keeps the real tag at the start of its sub format guid
+if(tag==0xfffe && chunk_size>=26 && available>=26)
+{
+tag=read16(chunk+24, big);
+}
+switch(sample_bits)
+{
+case 8:
+bits=BIT_TYPE_8BIT;
+break;
+case 16:
+bits=BIT_TYPE_16BIT;
+break;
+case 32:
+bits=BIT_TYPE_32BIT;
+break;
+default:
+throw std::runtime_error("unsupported wav sample size");
+}
+switch(tag)
+{
+case 1:
+encoding=(bits==BIT_TYPE_8BIT)?UNSIGNED_INTEGER:SIGNED_INTEGER;
+break;
+case 3:
+encoding=FLOATING_POINT;
+break;
+case 6:
+encoding=A_LAW;
+break;
+case 7:
+encoding=MU_LAW;
+break;
+default:
+throw std::runtime_error("unsupported wav encoding");
+}
+have_format=true;
+}
+else if(std::memcmp(base+pos, "data", 4)==0)
+{
+if(!have_format)
+{
+throw std::runtime_error("wav data before its format");
+}
+data=chunk;
+//streamed wavs leave the size at its maximum
+size=std::min((size_t)chunk_size, available);
+return;
+}
+//the chunks are padded to an even size
+pos+=8+(size_t)chunk_size+(chunk_size&1);
+}
+throw std::runtime_error("wav file without data");
+}
+
+public:
+//maps a wav file (RIFF or RIFX, with pcm, float, mu-law or a-law samples). throws std::runtime_error if it can't be read or parsed
+MappedAudioFile(const std::string& path):
+map(nullptr),
+map_size(0),
+data(nullptr),
+size(0),
+rate(0),
+bits(BIT_TYPE_16BIT),
+endian(LITTLE_ENDIAN),
+encoding(SIGNED_INTEGER),
+channels(1)
+{
+open(path);
+try
+{
+parseWav();
+}
+catch(...)
+{
+munmap(map, map_size);
+throw;
+}
+}
+
+//maps a raw file of the given format. throws std::runtime_error if it can't be read
+MappedAudioFile(const std::string& path, int sample_rate, BitsType bits, EndianType endian, EncodingType encoding, int channels=1):
+map(nullptr),
+map_size(0),
+data(nullptr),
+size(0),
+rate(sample_rate),
+bits(bits),
+endian(endian),
+encoding(encoding),
+channels(channels)
+{
+open(path);
+}
+
+~MappedAudioFile()
+{
+if(map!=nullptr)
+{
+munmap(map, map_size);
+}
+}
+
+//the mapped samples
+const char* getData() const
+{
+return data;
+}
+
+//the size of the samples in bytes
+size_t getSize() const
+{
+return size;
+}
+
+int getSampleRate() const
+{
+return rate;
+}
+
+BitsType getBits() const
+{
+return bits;
+}
+
+EndianType getEndian() const
+{
+return endian;
+}
+
+EncodingType getEncoding() const
+{
+return encoding;
+}
+
+int getChannels() const
+{
+return channels;
+}
+
+};
+#endif //WITPP_HAVE_MMAP
+
+class VoiceRequest: public Request
+{
+SourceFunction callback;
+ChunkSourceFunction chunk_callback;
+AudioChannel* channel;
+AudioSink sink;
+bool pipelined;
+size_t queue_chunks;
+PipelineStats pipeline_stats;
+int rate;
+bool rate_set;
+int capture_rate;
+std::string thread_id;
+std::string message_id;
+Context* context;
+int n_best;
+bool verbose;
+bool transcoding;
+EncodingType transcoding_type;
+bool capture_format;
+BitsType capture_bits;
+EndianType capture_endian;
+EncodingType capture_encoding;
+int capture_channels;
+#ifdef WITPP_HAVE_MMAP
+MappedAudioFile* file;
+#endif //WITPP_HAVE_MMAP
+#ifdef VAD_ENABLED
+bool endpointing;
+int trailing_silence_ms;
+int max_recording_ms;
+bool gating;
+int pre_roll_ms;
+wvs_params endpointing_params;
+#endif //VAD_ENABLED
+
+//appends the headers that describe the uploaded audio
+struct curl_slist* appendFormatHeaders(struct curl_slist* list, EncodingType encoding, BitsType bits, EndianType endian, int sample_rate)
+{
+static const char* encodings[]={"signed-integer", "unsigned-integer", "floating-point", "mu-law", "a-law", "ima-adpcm", "ms-adpcm", "gsm-full-rate"};
+std::string line="encoding: ";
+list=curl_slist_append(list, (line+encodings[encoding]).c_str());
+list=curl_slist_append(list, bits==BIT_TYPE_8BIT?"bits: 8":bits==BIT_TYPE_16BIT?"bits: 16":"bits: 32");
+list=curl_slist_append(list, endian==BIG_ENDIAN?"endian: big":"endian: little");
+list=curl_slist_append(list, ("rate: "+std::to_string(sample_rate)).c_str());
+return list;
+}
+
+public:
+
+VoiceRequest():
+Request(),
+verbose(false),
+context(nullptr),
+transcoding(false),
+transcoding_type(MU_LAW),
+capture_format(false),
+capture_bits(BIT_TYPE_16BIT),
+capture_endian(LITTLE_ENDIAN),
+capture_encoding(SIGNED_INTEGER),
+capture_channels(1)
+{
+channel=nullptr;
+pipelined=false;
+queue_chunks=16;
+std::memset(&pipeline_stats, 0, sizeof(pipeline_stats));
+#ifdef WITPP_HAVE_MMAP
+file=nullptr;
+#endif //WITPP_HAVE_MMAP
+#ifdef VAD_ENABLED
+endpointing=false;
+trailing_silence_ms=0;
+max_recording_ms=0;
+gating=false;
+pre_roll_ms=0;
+wvs_default_params(&endpointing_params);
+#endif //VAD_ENABLED
+headers=curl_slist_append(headers, "Content-Type: audio/raw");
+headers=curl_slist_append(headers, "endian: little");
+headers=curl_slist_append(headers, "bits: 16");
+headers=curl_slist_append(headers, "encoding: unsigned-integer");
+setHost(getHost()+"speech");
+n_best=1;
+rate=16000;
+rate_set=false;
+capture_rate=0;
+}
+
+VoiceRequest& setEndian(EndianType endian)
+{
+switch(endian)
+{
+case BIG_ENDIAN:
+headers=curl_slist_append(headers, "endian: big");
+break;
+case LITTLE_ENDIAN:
+headers=curl_slist_append(headers, "endian: little");
+break;
+}
+return *this;
+}
+
+VoiceRequest& setBitType(BitsType type)
+{
+switch(type)
+{
+case BIT_TYPE_8BIT:
+headers=curl_slist_append(headers, "bits: 8");
+break;
+case BIT_TYPE_16BIT:
+headers=curl_slist_append(headers, "bits: 16");
+break;
+case BIT_TYPE_32BIT:
+headers=curl_slist_append(headers, "bits: 32");
+break;
+}
+return *this;
+}
+
+VoiceRequest& setEncoding(EncodingType type)
+{
+switch(type)
+{
+case SIGNED_INTEGER:
+headers=curl_slist_append(headers, "encoding: signed-integer");
+break;
+case UNSIGNED_INTEGER:
+headers=curl_slist_append(headers, "encoding: unsigned-integer");
+break;
+case FLOATING_POINT:
+headers=curl_slist_append(headers, "encoding: floating-point");
+break;
+case MU_LAW:
+headers=curl_slist_append(headers, "encoding: mu-law");
+break;
+case A_LAW:
+headers=curl_slist_append(headers, "encoding: a-law");
+break;
+case IMA_ADPCM:
+headers=curl_slist_append(headers, "encoding: ima-adpcm");
+break;
+case MS_ADPCM:
+headers=curl_slist_append(headers, "encoding: ms-adpcm");
+break;
+case GSM_FULL_RATE:
+headers=curl_slist_append(headers, "encoding: gsm-full-rate");
+break;
+}
+return *this;
+}
+
+//the stream source. what it writes is moved to the sink after every call
+VoiceRequest& setSourceCallback(SourceFunction cb)
+{
+callback=cb;
+chunk_callback=nullptr;
+channel=nullptr;
+return *this;
+}
+
+SourceFunction getSourceCallback()
+{
+return callback;
+}
+
+//the sink source. your chunks go straight to the reusable buffer of the request, without the stream and its copies
+VoiceRequest& setChunkSourceCallback(ChunkSourceFunction cb)
+{
+chunk_callback=cb;
+callback=nullptr;
+channel=nullptr;
+return *this;
+}
+
+ChunkSourceFunction getChunkSourceCallback()
+{
+return chunk_callback;
+}
+
+//captures, processes (converts, resamples, endpoints and transcodes) and uploads the recording at the same time: the capture and the processing get their own threads, joined to the upload by queues of queue_chunks chunks, and the audio goes up with a chunked transfer while it is recorded
+//a full queue stops the stage before it, so a slow upload holds the source back instead of piling the audio up. link with your platform's thread library
+VoiceRequest& setPipelined(bool p, size_t queue_chunks=16)
+{
+pipelined=p;
+this->queue_chunks=queue_chunks;
+return *this;
+}
+
+bool getPipelined()
+{
+return pipelined;
+}
+
+//the counters of the stages of the last pipelined perform
+PipelineStats getPipelineStats()
+{
+return pipeline_stats;
+}
+
+//preallocates the buffer of the recording (in bytes), so even the first recordings don't allocate while they're captured
+VoiceRequest& reserveRecording(size_t bytes)
+{
+sink.reserve(bytes);
+return *this;
+}
+
+#ifdef WITPP_HAVE_MMAP
+//uploads a mapped file instead of recording from the source callback. its header gives the format and, unless setSampleRate was called, the rate of the upload. a mono file that isn't resampled and doesn't need to be transcoded, endpointed or gated goes to curl straight from the mapping. others are converted from the mapping as they would be from the callback
+//the file must live until perform returns. nullptr goes back to the source callback
+VoiceRequest& setSourceFile(MappedAudioFile* f)
+{
+file=f;
+return *this;
+}
+#endif //WITPP_HAVE_MMAP
+
+//records from a ring buffer that your capture thread pushes 16 bit samples to, until it gets closed. the samples are sent as little endian
+VoiceRequest& setSourceRing(AudioRingBuffer& ring)
+{
+AudioRingBuffer* r=&ring;
+return setChunkSourceCallback([r](AudioSink& sink) -> RecordingStatus
+{
+int16_t samples[1024];
+//whatever was pushed before the close is visible once the close is
+bool closed=r->isClosed();
+size_t total=0;
+size_t n;
+while((n=r->pop(samples, 1024))>0)
+{
+sink.write(samples, n);
+total+=n;
+}
+if(total==0)
+{
+if(closed)
+{
+return RECORDING_STOPPED;
+}
+std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+return RECORDING_CONTINUE;
+});
+}
+
+//records from a channel that your capture thread writes to, until it gets closed. perform sleeps while there's nothing to read instead of polling the source
+//the request closes the channel once the upload is over (e.g when the endpointer stopped the recording), so the writes of the producer return false. reset it before the next recording
+VoiceRequest& setSourceChannel(AudioChannel& c)
+{
+AudioChannel* ch=&c;
+setChunkSourceCallback([ch](AudioSink& sink) -> RecordingStatus
+{
+return ch->read(sink);
+});
+channel=ch;
+return *this;
+}
+
+//the sample rate of the uploaded audio. a source file is uploaded at its own rate unless this was called, and resampled otherwise
+VoiceRequest& setSampleRate(int sample_rate)
+{
+rate=sample_rate;
+rate_set=true;
+return *this;
+}
+
+int getSampleRate()
+{
+return rate;
+}
+
+//the sample rate your source callback records at, if it isn't the one of the upload (e.g 44100 or 48000). the 16 bit signed little endian recording gets resampled to getSampleRate() as it comes (0 turns it off)
+VoiceRequest& setCaptureRate(int sample_rate)
+{
+capture_rate=sample_rate;
+return *this;
+}
+
+int getCaptureRate()
+{
+return capture_rate;
+}
+
+//the format your source callback records in, if it isn't 16 bit signed little endian mono. the recording gets converted as it comes and is uploaded as 16 bit signed little endian mono (or G.711 with setTranscoding), and the headers say so
+//throws std::invalid_argument for the formats that can't be converted (see SampleConverter)
+VoiceRequest& setCaptureFormat(BitsType bits, EndianType endian, EncodingType encoding, int channels=1)
+{
+SampleConverter check(bits, endian, encoding, channels);
+capture_format=true;
+capture_bits=bits;
+capture_endian=endian;
+capture_encoding=encoding;
+capture_channels=channels;
+return *this;
+}
+
+VoiceRequest& disableCaptureFormat()
+{
+capture_format=false;
+capture_bits=BIT_TYPE_16BIT;
+capture_endian=LITTLE_ENDIAN;
+capture_encoding=SIGNED_INTEGER;
+capture_channels=1;
+return *this;
+}
+
+VoiceRequest& setMessageId(std::string id)
+{
+message_id=id;
+return *this;
+}
+
+std::string getMessageId()
+{
+return message_id;
+}
+
+VoiceRequest& setThreadId(std::string id)
+{
+thread_id=id;
+return *this;
+}
+
+std::string getThreadId()
+{
+return thread_id;
+}
+
+VoiceRequest& setContext(Context* c)
+{
+context=c;
+return *this;
+}
+
+Context getContext()
+{
+return *context;
+}
+
+VoiceRequest& setNBest(int n)
+{
+n_best=n;
+return *this;
+}
+
+int getNBest()
+{
+return n_best;
+}
+
+VoiceRequest&setVerbose(bool v)
+{
+verbose=v;
+return *this;
+}
+
+bool getVerbose()
+{
+return verbose;
+}
+
+//records 16 bit signed little endian samples and uploads them as MU_LAW or A_LAW, which halves the upload. the encoding and bits headers are set for you
+VoiceRequest& setTranscoding(EncodingType type)
+{
+if(type!=MU_LAW && type!=A_LAW)
+{
+throw std::invalid_argument("only MU_LAW and A_LAW can be transcoded to");
+}
+transcoding=true;
+transcoding_type=type;
+return *this;
+}
+
+VoiceRequest& disableTranscoding()
+{
+transcoding=false;
+return *this;
+}
+
+bool getTranscoding()
+{
+return transcoding;
+}
+
+#ifdef VAD_ENABLED
+//stops the recording by itself once trailing_silence_ms of silence follows the speech, or once max_recording_ms of audio has been recorded, counted from the start of the recording and not of the speech (0 for no limit), so your source callback can keep returning RECORDING_CONTINUE. the audio must be 16 bit signed little endian samples at getSampleRate()
+VoiceRequest& setEndpointing(int trailing_silence_ms, int max_recording_ms=0)
+{
+endpointing=true;
+this->trailing_silence_ms=trailing_silence_ms;
+this->max_recording_ms=max_recording_ms;
+return *this;
+}
+
+//tunes the voice detector of the endpointing and of the gating (start from wvs_default_params)
+VoiceRequest& setEndpointingParams(const wvs_params& params)
+{
+endpointing_params=params;
+return *this;
+}
+
+VoiceRequest& disableEndpointing()
+{
+endpointing=false;
+return *this;
+}
+
+bool getEndpointing()
+{
+return endpointing;
+}
+
+//uploads nothing before the speech starts, but the last pre_roll_ms before it: the voice detector is late on the start of the speech, and the ring of the pre-roll lets out what it would clip
+VoiceRequest& setGating(int pre_roll_ms=250)
+{
+gating=true;
+this->pre_roll_ms=pre_roll_ms;
+return *this;
+}
+
+VoiceRequest& disableGating()
+{
+gating=false;
+return *this;
+}
+
+bool getGating()
+{
+return gating;
+}
+#endif //VAD_ENABLED
+
+MessageResponce perform()
+{
+std::string s="";
+s+="?v="+param.getVersion();
+if(context!=nullptr)
+{
+std::string ctx=(std::string)*context;
+s+="&context="+(std::string)curl_escape(ctx.c_str(), ctx.length());
+}
+if(message_id!="")
+{
+s+="&msg_id="+(std::string)curl_escape(message_id.c_str(), message_id.length());
+}
+if(thread_id!="")
+{
+s+="&thread_id="+(std::string)curl_escape(thread_id.c_str(), thread_id.length());
+}
+s+="&n="+n_best;
+s+="&verbose="+verbose?"1":"0";
+std::string url=host+s;
+res=curl_easy_setopt(c, CURLOPT_URL, url.c_str());
+res=curl_easy_setopt(c, CURLOPT_FOLLOWLOCATION, 1L);
+if(getTimeout()!=0)
+{
+res=curl_easy_setopt(c, CURLOPT_TIMEOUT, getTimeout());
+}
+int r=RECORDING_STARTED;
+std::string body;
+const char* upload=nullptr;
+size_t upload_size=0;
+BitsType bits=capture_bits;
+EndianType endian=capture_endian;
+EncodingType encoding=capture_encoding;
+int channels=capture_channels;
+int input_rate=capture_rate;
+int upload_rate=rate;
+//the chunks are read as they come when they have to be converted, resampled, encoded or listened to
+bool chunked=transcoding || capture_format;
+#ifdef WITPP_HAVE_MMAP
+//a file brings its own format and rate
+if(file!=nullptr)
+{
+bits=file->getBits();
+endian=file->getEndian();
+encoding=file->getEncoding();
+channels=file->getChannels();
+input_rate=file->getSampleRate();
+if(!rate_set)
+{
+upload_rate=input_rate;
+}
+chunked=chunked || channels!=1;
+}
+#endif //WITPP_HAVE_MMAP
+chunked=chunked || (input_rate>0 && input_rate!=upload_rate);
+#ifdef VAD_ENABLED
+chunked=chunked || endpointing || gating;
+#endif //VAD_ENABLED
+std::unique_ptr<VoiceProcessor> processor;
+std::unique_ptr<VoicePipeline> pipeline;
+//the channel is closed however perform ends (e.g when the processor or the source throws), so the producer learns that the recording is over. it's destroyed before the pipeline, whose capture thread may be waiting for the channel
+struct ChannelCloser
+{
+AudioChannel* channel;
+~ChannelCloser()
+{
+if(channel!=nullptr)
+{
+channel->close();
+}
+}
+} closer={channel};
+if(chunked)
+{
+processor.reset(new VoiceProcessor(bits, endian, encoding, channels, input_rate, upload_rate, transcoding, transcoding_type));
+#ifdef VAD_ENABLED
+if(endpointing)
+{
+processor->setEndpointing(upload_rate, trailing_silence_ms, max_recording_ms, endpointing_params);
+}
+if(gating)
+{
+processor->setGating(upload_rate, pre_roll_ms, endpointing_params);
+}
+#endif //VAD_ENABLED
+}
+ChunkSourceFunction source=chunk_callback;
+std::stringstream stream;
+bool direct_file=false;
+#ifdef WITPP_HAVE_MMAP
+size_t file_offset=0;
+if(file!=nullptr)
+{
+direct_file=!chunked;
+//a tenth of a second at a time, so the endpointer stops close to the end of the speech
+size_t frame_size=SampleConverter(bits, endian, encoding, channels).getFrameSize();
+size_t step=std::max(input_rate/10, 1)*frame_size;
+MappedAudioFile* f=file;
+source=[f, step, &file_offset](AudioSink& out) -> RecordingStatus
+{
+size_t n=std::min(step, f->getSize()-file_offset);
+out.write((const void*)(f->getData()+file_offset), n);
+file_offset+=n;
+return file_offset<f->getSize()?RECORDING_CONTINUE:RECORDING_STOPPED;
+};
+}
+#endif //WITPP_HAVE_MMAP
+if(!source)
+{
+//the stream source gets adapted to the sink
+source=[this, &stream](AudioSink& out) -> RecordingStatus
+{
+RecordingStatus status=callback(stream);
+if(status==RECORDING_CONTINUE)
+{
+stream.flush();
+}
+char buf[4096];
+std::streamsize n;
+while((n=stream.rdbuf()->sgetn(buf, sizeof(buf)))>0)
+{
+out.write((const void*)buf, n);
+}
+return status;
+};
+}
+if(direct_file)
+{
+#ifdef WITPP_HAVE_MMAP
+//the mapped samples go to curl as they are
+upload=file->getData();
+upload_size=file->getSize();
+#endif //WITPP_HAVE_MMAP
+}
+else if(pipelined)
+{
+//the recording is uploaded while it is captured and processed
+pipeline.reset(new VoicePipeline(source, processor.get(), queue_chunks));
+}
+else
+{
+sink.clear();
+size_t consumed=0;
+do
+{
+r=source(sink);
+if(processor && processor->process(sink.getData()+consumed, sink.getSize()-consumed, r==RECORDING_STOPPED, body))
+{
+r=RECORDING_STOPPED;
+}
+consumed=sink.getSize();
+}while(r!=RECORDING_STOPPED);
+if(processor)
+{
+upload=body.data();
+upload_size=body.size();
+}
+else
+{
+upload=sink.getData();
+upload_size=sink.getSize();
+}
+}
+//the headers of this perform are a copy, so a request that is performed again (e.g for every file of a batch) doesn't pile them up
+struct curl_slist* request_headers=nullptr;
+for(struct curl_slist* h=headers; h!=nullptr; h=h->next)
+{
+std::string line=h->data;
+bool format=line.compare(0, 9, "encoding:")==0 || line.compare(0, 5, "bits:")==0 || line.compare(0, 7, "endian:")==0 || line.compare(0, 5, "rate:")==0;
+//the format headers of the recording get replaced by the ones of what is uploaded
+if(!format || !(chunked || direct_file))
+{
+request_headers=curl_slist_append(request_headers, h->data);
+}
+}
+if(chunked)
+{
+request_headers=appendFormatHeaders(request_headers, transcoding?transcoding_type:SIGNED_INTEGER, transcoding?BIT_TYPE_8BIT:BIT_TYPE_16BIT, LITTLE_ENDIAN, upload_rate);
+}
+else if(direct_file)
+{
+request_headers=appendFormatHeaders(request_headers, encoding, bits, endian, input_rate);
+}
+if(pipeline)
+{
+request_headers=curl_slist_append(request_headers, "Transfer-Encoding: chunked");
+}
+std::string token_header="Authorization: Bearer "+param.getAuth();
+request_headers=curl_slist_append(request_headers, token_header.c_str());
+res=curl_easy_setopt(c, CURLOPT_HTTPHEADER, request_headers);
+res=curl_easy_setopt(c, CURLOPT_POST, 1L);
+if(pipeline)
+{
+//curl reads the chunks as the pipeline gives them
+res=curl_easy_setopt(c, CURLOPT_POSTFIELDS, (char*)nullptr);
+res=curl_easy_setopt(c, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)-1);
+res=curl_easy_setopt(c, CURLOPT_READFUNCTION, VoicePipeline::readcb);
+res=curl_easy_setopt(c, CURLOPT_READDATA, pipeline.get());
+}
+else
+{
+//the audio may hold zero bytes, so its size is given
+res=curl_easy_setopt(c, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)upload_size);
+res=curl_easy_setopt(c, CURLOPT_POSTFIELDS, upload);
+}
+std::unique_ptr<std::string> data(new std::string());;
+res=curl_easy_setopt(c, CURLOPT_WRITEDATA, data.get());
+if(pipeline)
+{
+pipeline->start();
+}
+res=curl_easy_perform(c);
+curl_slist_free_all(request_headers);
+//the producer learns that the recording is over, and the capture thread isn't left waiting for it
+if(channel!=nullptr)
+{
+channel->close();
+}
+if(pipeline)
+{
+res=curl_easy_setopt(c, CURLOPT_READFUNCTION, readcb);
+pipeline->finish();
+pipeline_stats=pipeline->getStats();
+}
+int httpcode;
+curl_easy_getinfo(c, CURLINFO_RESPONSE_CODE, &httpcode);
+if(httpcode==200)
+{
+return MessageResponce(*data.get());
+}
+else
+{
+throw WitException(httpcode);
+}
+}
+
+};
+
+//this class represents a responce for getting entities
+class EntitiesResponce: public Responce
+{
+public:
+
+EntitiesResponce(std::string s):
+Responce(s)
+{
+
+}
+
+std::vector<std::string> getEntities()
+{
+std::vector<std::string> data;
+for(unsigned int i=0;i<responce.size();i++)
+{
+data.push_back(responce[i].asString());
+}
+return data;
+}
+
+};
+
+//this class represents a request for getting entities
+class EntitiesRequest: public Request
+{
+public:
+EntitiesRequest():
+Request()
+{
+setHost(getHost()+"entities");
+}
+
+EntitiesResponce perform()
+{
+std::string s="";
+s+="?v="+param.getVersion();
 std::string token_header="Authorization: Bearer "+param.getAuth();
 headers=curl_slist_append(headers, token_header.c_str());
 std::string url=host+s;
@@ -1412,6 +4078,539 @@ throw WitException(httpcode);
 
 };
 
+#ifdef WITPP_HAVE_MMAP
+
+//the outcome of one file of a BulkTranscriber
+struct TranscriptionResult
+{
+std::string path;
+bool ok;
+//the http code (or the code of the wit.ai error) when it failed, 0 for the other errors
+int code;
+std::string error;
+std::string text;
+std::string message_id;
+Json::Value entities;
+double audio_s;
+//the time to map the file, to upload it and get the responce, and both
+double open_ms;
+double request_ms;
+double total_ms;
+};
+
+struct BulkStats
+{
+size_t files;
+//the files the checkpoint says are done already
+size_t skipped;
+size_t succeeded;
+size_t failed;
+double audio_s;
+double wall_ms;
+};
+
+//this class transcribes a list of wav files (e.g recorded calls after a model update) on a few workers at once, and writes one json line per file to an ndjson file
+//every worker keeps its VoiceRequest, so curl keeps its connection to wit.ai open from a file to the next. the files that went through are appended to a checkpoint file, and a run with the same checkpoint skips them: a crash doesn't start the corpus over
+class BulkTranscriber
+{
+typedef std::chrono::steady_clock Clock;
+Parameter param;
+std::vector<std::string> files;
+size_t workers;
+std::string output_path;
+std::string checkpoint_path;
+std::function<void (VoiceRequest&)> setup;
+std::function<void (const TranscriptionResult&)> progress;
+std::mutex output_mutex;
+std::ofstream output;
+std::ofstream checkpoint;
+std::atomic<size_t> next;
+std::atomic<bool> failed;
+std::exception_ptr error;
+BulkStats stats;
+BulkTranscriber(const BulkTranscriber&);
+BulkTranscriber& operator=(const BulkTranscriber&);
+
+static double elapsed(Clock::time_point since)
+{
+return std::chrono::duration<double, std::milli>(Clock::now()-since).count();
+}
+
+TranscriptionResult transcribe(VoiceRequest& request, const std::string& path)
+{
+TranscriptionResult result;
+result.path=path;
+result.ok=false;
+result.code=0;
+result.audio_s=0;
+result.open_ms=0;
+result.request_ms=0;
+Clock::time_point start=Clock::now();
+try
+{
+MappedAudioFile file(path);
+result.open_ms=elapsed(start);
+size_t frame_size=SampleConverter(file.getBits(), file.getEndian(), file.getEncoding(), file.getChannels()).getFrameSize();
+result.audio_s=(double)(file.getSize()/frame_size)/file.getSampleRate();
+request.setSourceFile(&file);
+Clock::time_point sent=Clock::now();
+MessageResponce responce=request.perform();
+result.request_ms=elapsed(sent);
+result.text=responce.getText();
+result.message_id=responce.getMessageId();
+result.entities=responce.getEntities();
+result.ok=true;
+}
+catch(WitException& e)
+{
+result.code=e.getCode();
+result.error=e.what();
+}
+catch(std::exception& e)
+{
+result.error=e.what();
+}
+request.setSourceFile(nullptr);
+result.total_ms=elapsed(start);
+return result;
+}
+
+void write(const TranscriptionResult& result)
+{
+Json::Value line;
+line["path"]=result.path;
+line["ok"]=result.ok;
+if(result.ok)
+{
+line["text"]=result.text;
+line["msg_id"]=result.message_id;
+line["entities"]=result.entities;
+}
+else
+{
+line["code"]=result.code;
+line["error"]=result.error;
+}
+line["audio_s"]=result.audio_s;
+line["open_ms"]=result.open_ms;
+line["request_ms"]=result.request_ms;
+line["total_ms"]=result.total_ms;
+Json::StreamWriterBuilder builder;
+builder["indentation"]="";
+builder["precision"]=6;
+std::string json=Json::writeString(builder, line);
+std::lock_guard<std::mutex> lock(output_mutex);
+//the result is out before the file is checkpointed, so a crash in between sends the file again rather than losing it
+output<<json<<'\n';
+output.flush();
+//e.g a full disk: the run must not look like it went through
+if(!output)
+{
+throw std::runtime_error("can't write the output "+output_path);
+}
+if(result.ok)
+{
+stats.succeeded++;
+stats.audio_s+=result.audio_s;
+if(checkpoint.is_open())
+{
+checkpoint<<result.path<<'\n';
+checkpoint.flush();
+if(!checkpoint)
+{
+throw std::runtime_error("can't write the checkpoint "+checkpoint_path);
+}
+}
+}
+else
+{
+stats.failed++;
+}
+if(progress)
+{
+progress(result);
+}
+}
+
+//an exception (from the progress callback, the output or the memory) stops every worker, and run throws the first one
+void work(VoiceRequest* request, const std::vector<std::string>* todo)
+{
+try
+{
+size_t i;
+while(!failed.load() && (i=next.fetch_add(1))<todo->size())
+{
+write(transcribe(*request, (*todo)[i]));
+}
+}
+catch(...)
+{
+std::lock_guard<std::mutex> lock(output_mutex);
+if(!error)
+{
+error=std::current_exception();
+}
+failed=true;
+}
+}
+
+public:
+BulkTranscriber(Parameter& p):
+param(p),
+workers(4),
+next(0),
+failed(false)
+{
+std::memset(&stats, 0, sizeof(stats));
+}
+
+BulkTranscriber& addFile(std::string path)
+{
+files.push_back(path);
+return *this;
+}
+
+//adds the files of a directory (not its subdirectories) that end with extension, in the order of their names. throws std::runtime_error if it can't be read
+BulkTranscriber& addDirectory(std::string path, std::string extension=".wav")
+{
+DIR* dir=opendir(path.c_str());
+if(dir==nullptr)
+{
+throw std::runtime_error("can't read the directory "+path);
+}
+std::vector<std::string> names;
+struct dirent* entry;
+while((entry=readdir(dir))!=nullptr)
+{
+std::string name=entry->d_name;
+if(name.size()>extension.size() && name.compare(name.size()-extension.size(), extension.size(), extension)==0)
+{
+names.push_back(name);
+}
+}
+closedir(dir);
+std::sort(names.begin(), names.end());
+for(size_t i=0; i<names.size(); i++)
+{
+files.push_back(path+"/"+names[i]);
+}
+return *this;
+}
+
+//the number of files transcribed at once, each on its own thread and connection
+BulkTranscriber& setWorkers(size_t n)
+{
+workers=std::max((size_t)1, n);
+return *this;
+}
+
+size_t getWorkers()
+{
+return workers;
+}
+
+//the ndjson file the results are appended to
+BulkTranscriber& setOutput(std::string path)
+{
+output_path=path;
+return *this;
+}
+
+//the file that lists the transcribed files. the files it lists are skipped, and the new ones are appended to it. the failed files aren't listed, so the next run tries them again
+BulkTranscriber& setCheckpoint(std::string path)
+{
+checkpoint_path=path;
+return *this;
+}
+
+//called on every worker's VoiceRequest before the run (e.g to set the timeout, the transcoding or the endpointing)
+BulkTranscriber& setRequestSetup(std::function<void (VoiceRequest&)> f)
+{
+setup=f;
+return *this;
+}
+
+//called after every file, one at a time
+BulkTranscriber& setProgressCallback(std::function<void (const TranscriptionResult&)> f)
+{
+progress=f;
+return *this;
+}
+
+//transcribes the files and returns the counters. throws std::runtime_error if the output or the checkpoint can't be opened or written, and rethrows what the progress callback threw, once the workers have stopped
+BulkStats run()
+{
+std::memset(&stats, 0, sizeof(stats));
+Clock::time_point start=Clock::now();
+std::set<std::string> done;
+if(!checkpoint_path.empty())
+{
+std::ifstream in(checkpoint_path.c_str());
+std::string line;
+while(std::getline(in, line))
+{
+done.insert(line);
+}
+checkpoint.open(checkpoint_path.c_str(), std::ios::app);
+if(!checkpoint.is_open())
+{
+throw std::runtime_error("can't open the checkpoint "+checkpoint_path);
+}
+}
+output.open(output_path.empty()?"/dev/null":output_path.c_str(), std::ios::app);
+if(!output.is_open())
+{
+checkpoint.close();
+throw std::runtime_error("can't open the output "+output_path);
+}
+std::vector<std::string> todo;
+for(size_t i=0; i<files.size(); i++)
+{
+if(done.count(files[i])==0)
+{
+todo.push_back(files[i]);
+}
+}
+stats.files=files.size();
+stats.skipped=files.size()-todo.size();
+next=0;
+failed=false;
+error=nullptr;
+//the requests are made here, as curl_easy_init isn't safe to call from many threads before curl_global_init
+size_t n=std::min(workers, std::max(todo.size(), (size_t)1));
+std::vector<std::unique_ptr<VoiceRequest>> requests;
+for(size_t i=0; i<n; i++)
+{
+requests.push_back(std::unique_ptr<VoiceRequest>(new VoiceRequest()));
+requests[i]->setParameter(param);
+if(setup)
+{
+setup(*requests[i]);
+}
+}
+std::vector<std::thread> threads;
+try
+{
+//reserved, so a push_back never drops a running thread
+threads.reserve(n-1);
+for(size_t i=1; i<n; i++)
+{
+threads.push_back(std::thread(&BulkTranscriber::work, this, requests[i].get(), &todo));
+}
+}
+catch(...)
+{
+//a thread couldn't be started: the ones that were stop after their current file
+failed=true;
+for(size_t i=0; i<threads.size(); i++)
+{
+threads[i].join();
+}
+output.close();
+checkpoint.close();
+throw;
+}
+work(requests[0].get(), &todo);
+for(size_t i=0; i<threads.size(); i++)
+{
+threads[i].join();
+}
+output.close();
+checkpoint.close();
+stats.wall_ms=elapsed(start);
+if(error)
+{
+std::rethrow_exception(error);
+}
+return stats;
+}
+
+};
+
+#endif //WITPP_HAVE_MMAP
+
+#ifdef VAD_ENABLED
+
+//the recognition of one segment of a SegmentedTranscriber
+struct SegmentTranscription
+{
+AudioSegment segment;
+//the segment in seconds from the start of the recording
+double start_s;
+double end_s;
+bool ok;
+//the http code (or the code of the wit.ai error) when it failed, 0 for the other errors
+int code;
+std::string error;
+//nullptr when it failed
+std::shared_ptr<MessageResponce> responce;
+double request_ms;
+};
+
+//this class transcribes a long recording: it is split at its silences by a Segmenter, and the segments are sent on a few VoiceRequests at once. the results come back in the order of the recording, with the offsets of their segments
+class SegmentedTranscriber
+{
+typedef std::chrono::steady_clock Clock;
+Parameter param;
+Segmenter segmenter;
+int sample_rate;
+size_t workers;
+std::function<void (VoiceRequest&)> setup;
+std::atomic<size_t> next;
+SegmentedTranscriber(const SegmentedTranscriber&);
+SegmentedTranscriber& operator=(const SegmentedTranscriber&);
+
+void work(VoiceRequest* request, const int16_t* samples, std::vector<SegmentTranscription>* results)
+{
+size_t i;
+while((i=next.fetch_add(1))<results->size())
+{
+SegmentTranscription& result=(*results)[i];
+const int16_t* data=samples+result.segment.start;
+size_t size=(size_t)(result.segment.end-result.segment.start);
+Clock::time_point start=Clock::now();
+//whatever is thrown is the error of this segment, and the worker goes on with the next one
+try
+{
+request->setChunkSourceCallback([data, size](AudioSink& sink) -> RecordingStatus
+{
+sink.write(data, size);
+return RECORDING_STOPPED;
+});
+result.responce=std::make_shared<MessageResponce>(request->perform());
+result.ok=true;
+}
+catch(WitException& e)
+{
+result.code=e.getCode();
+result.error=e.what();
+}
+catch(std::exception& e)
+{
+result.error=e.what();
+}
+catch(...)
+{
+result.error="unknown exception";
+}
+result.request_ms=std::chrono::duration<double, std::milli>(Clock::now()-start).count();
+}
+}
+
+public:
+//the recording is 16 bit samples at sample_rate, and is uploaded at that rate
+SegmentedTranscriber(Parameter& p, int sample_rate, const Segmenter& segmenter):
+param(p),
+segmenter(segmenter),
+sample_rate(sample_rate),
+workers(4),
+next(0)
+{
+}
+
+//the number of segments sent at once, each on its own thread and connection
+SegmentedTranscriber& setWorkers(size_t n)
+{
+workers=std::max((size_t)1, n);
+return *this;
+}
+
+size_t getWorkers()
+{
+return workers;
+}
+
+//called on every worker's VoiceRequest before the segments are sent (e.g to set the timeout or the transcoding)
+SegmentedTranscriber& setRequestSetup(std::function<void (VoiceRequest&)> f)
+{
+setup=f;
+return *this;
+}
+
+//splits the recording and transcribes its segments. the samples must live until it returns
+std::vector<SegmentTranscription> transcribe(const int16_t* samples, size_t size)
+{
+std::vector<AudioSegment> segments=segmenter.split(samples, size);
+std::vector<SegmentTranscription> results(segments.size());
+for(size_t i=0; i<segments.size(); i++)
+{
+results[i].segment=segments[i];
+results[i].start_s=(double)segments[i].start/sample_rate;
+results[i].end_s=(double)segments[i].end/sample_rate;
+results[i].ok=false;
+results[i].code=0;
+results[i].request_ms=0;
+}
+if(results.empty())
+{
+return results;
+}
+next=0;
+//the requests are made here, as curl_easy_init isn't safe to call from many threads before curl_global_init
+size_t n=std::min(workers, results.size());
+std::vector<std::unique_ptr<VoiceRequest>> requests;
+for(size_t i=0; i<n; i++)
+{
+requests.push_back(std::unique_ptr<VoiceRequest>(new VoiceRequest()));
+requests[i]->setParameter(param);
+requests[i]->setSampleRate(sample_rate);
+//the headers then describe the samples, and rate says their rate
+requests[i]->setCaptureFormat(BIT_TYPE_16BIT, LITTLE_ENDIAN, SIGNED_INTEGER);
+if(setup)
+{
+setup(*requests[i]);
+}
+}
+std::vector<std::thread> threads;
+try
+{
+//reserved, so a push_back never drops a running thread
+threads.reserve(n-1);
+for(size_t i=1; i<n; i++)
+{
+threads.push_back(std::thread(&SegmentedTranscriber::work, this, requests[i].get(), samples, &results));
+}
+}
+catch(...)
+{
+//a thread couldn't be started: the segments are shared by the workers that were
+}
+work(requests[0].get(), samples, &results);
+for(size_t i=0; i<threads.size(); i++)
+{
+threads[i].join();
+}
+return results;
+}
+
+//the texts of the recognised segments, in order, separated by spaces
+static std::string joinText(const std::vector<SegmentTranscription>& results)
+{
+std::string text;
+for(size_t i=0; i<results.size(); i++)
+{
+if(!results[i].ok)
+{
+continue;
+}
+std::string t=results[i].responce->getText();
+if(t.empty())
+{
+continue;
+}
+if(!text.empty())
+{
+text+=" ";
+}
+text+=t;
+}
+return text;
+}
+
+};
+
+#endif //VAD_ENABLED
+
 }
 
 #endif //_WITPP_H
@@ -247,6 +247,8 @@ static inline void fixZerosInTheEnd(char* begin, char* end) {
 #include <memory>
 #include <set>
 #include <limits>
+#include <cmath>
+#include <thread>
 
 #if defined(_MSC_VER)
 #if !defined(WINCE) && defined(__STDC_SECURE_LIB__) && _MSC_VER >= 1500 // VC++ 9.0 and above 
@@ -1133,6 +1135,7 @@ public:
   bool failIfExtra_;
   bool rejectDupKeys_;
   bool allowSpecialFloats_;
+  bool internKeys_;
   int stackLimit_;
 };  // OurFeatures
 
@@ -1160,6 +1163,10 @@ public:
              const char* endDoc,
              Value& root,
              bool collectComments = true);
+  bool parseElement(const char* beginDoc,
+                    const char* beginValue,
+                    const char* endValue,
+                    Value& value);
   JSONCPP_STRING getFormattedErrorMessages() const;
   std::vector<StructuredError> getStructuredErrors() const;
   bool pushError(const Value& value, const JSONCPP_STRING& message);
@@ -1326,6 +1333,33 @@ bool OurReader::parse(const char* beginDoc,
   return successful;
 }
 
+// Parse the single value in [beginValue, endValue), an element of the root
+// array of the document starting at beginDoc, so that offsets and error
+// locations are relative to the whole document.
+bool OurReader::parseElement(const char* beginDoc,
+                             const char* beginValue,
+                             const char* endValue,
+                             Value& value) {
+  begin_ = beginDoc;
+  end_ = endValue;
+  collectComments_ = false;
+  current_ = beginValue;
+  lastValueEnd_ = 0;
+  lastValue_ = 0;
+  commentsBefore_.clear();
+  errors_.clear();
+  while (!nodes_.empty())
+    nodes_.pop();
+  // Stand-in for the root array, so that stackLimit counts the same depth.
+  nodes_.push(&value);
+  nodes_.push(&value);
+
+  bool successful = readValue();
+  Token token;
+  skipCommentTokens(token);
+  return successful && token.type_ == tokenEndOfStream;
+}
+
 bool OurReader::readValue() {
   //  To preserve the old behaviour we cast size_t to int.
   if (static_cast<int>(nodes_.size()) > features_.stackLimit_) throwRuntimeError("Exceeded stackLimit in readValue().");
@@ -1727,7 +1761,11 @@ bool OurReader::readObject(Token& tokenStart) {
       return addErrorAndRecover(
           msg, tokenName, tokenObjectEnd);
     }
-    Value& value = currentValue()[name];
+    char const* interned = features_.internKeys_
+        ? KeyInternTable::find(name.data(), name.data() + name.length())
+        : NULL;
+    Value& value = interned ? currentValue()[StaticString(interned)]
+                            : currentValue()[name];
     nodes_.push(&value);
     bool ok = readValue();
     nodes_.pop();
@@ -2149,19 +2187,189 @@ bool OurReader::good() const {
 }
 
 
+// Parallel parsing of a root array
+// ////////////////////////////////
+
+struct ElementRange {
+  char const* begin_;
+  char const* end_;
+};
+
+static char const* skipJsonSpaces(char const* current, char const* end) {
+  while (current != end && (*current == ' ' || *current == '\t' ||
+                            *current == '\r' || *current == '\n'))
+    ++current;
+  return current;
+}
+
+// Structural pre-scan of a document whose root is an array: find the
+// [begin, end) range of each element without decoding anything. Anything
+// unusual (comments, dropped placeholders, unbalanced brackets, trailing
+// text...) returns false and is left to the serial parser.
+static bool scanArrayElements(char const* beginDoc,
+                              char const* endDoc,
+                              bool allowSingleQuotes,
+                              std::vector<ElementRange>& elements,
+                              char const*& arrayBegin,
+                              char const*& arrayEnd) {
+  char const* current = skipJsonSpaces(beginDoc, endDoc);
+  if (current == endDoc || *current != '[')
+    return false;
+  arrayBegin = current;
+  current = skipJsonSpaces(current + 1, endDoc);
+  char const* elementBegin = current;
+  int depth = 0; // nesting inside the current element
+  while (current != endDoc) {
+    char c = *current;
+    if (c == '"' || (c == '\'' && allowSingleQuotes)) {
+      for (++current; current != endDoc && *current != c; ++current) {
+        if (*current == '\\' && ++current == endDoc)
+          return false;
+      }
+      if (current == endDoc)
+        return false;
+    } else if (c == '[' || c == '{') {
+      ++depth;
+    } else if (c == ']' || c == '}') {
+      if (depth == 0) {
+        if (c != ']' || current == elementBegin)
+          return false;
+        ElementRange element = {elementBegin, current};
+        elements.push_back(element);
+        arrayEnd = current + 1;
+        return skipJsonSpaces(arrayEnd, endDoc) == endDoc;
+      }
+      --depth;
+    } else if (c == ',' && depth == 0) {
+      if (current == elementBegin)
+        return false;
+      ElementRange element = {elementBegin, current};
+      elements.push_back(element);
+      current = skipJsonSpaces(current + 1, endDoc);
+      elementBegin = current;
+      continue;
+    } else if (c == '/') {
+      return false;
+    }
+    ++current;
+  }
+  return false;
+}
+
+// Parse the elements of a root array on several threads, each with its own
+// OurReader, into slots created beforehand. Return false if the document does
+// not qualify or any element fails; the caller then parses serially, which
+// also produces the usual error messages.
+static bool parseArrayInParallel(OurFeatures const& features,
+                                 unsigned threads,
+                                 char const* beginDoc,
+                                 char const* endDoc,
+                                 Value& root) {
+  std::vector<ElementRange> elements;
+  char const* arrayBegin = 0;
+  char const* arrayEnd = 0;
+  if (!scanArrayElements(beginDoc, endDoc, features.allowSingleQuotes_,
+                         elements, arrayBegin, arrayEnd))
+    return false;
+  if (elements.size() < 2)
+    return false;
+  Value array(arrayValue);
+  std::vector<Value*> slots(elements.size());
+  for (size_t i = 0; i < elements.size(); ++i)
+    slots[i] = &array[ArrayIndex(i)];
+
+  // Contiguous batches of about the same number of bytes.
+  unsigned workers = static_cast<unsigned>(
+      std::min<size_t>(threads, elements.size()));
+  std::vector<size_t> firsts(workers + 1, elements.size());
+  firsts[0] = 0;
+  size_t total = static_cast<size_t>(arrayEnd - arrayBegin);
+  unsigned batch = 1;
+  for (size_t i = 0; i < elements.size() && batch < workers; ++i) {
+    if (static_cast<size_t>(elements[i].begin_ - arrayBegin) >=
+        total / workers * batch)
+      firsts[batch++] = i;
+  }
+  for (; batch < workers; ++batch)
+    firsts[batch] = elements.size();
+
+  std::vector<char> failed(workers, 0);
+  struct Worker {
+    static void run(OurFeatures const* features, char const* beginDoc,
+                    ElementRange const* elements, Value* const* slots,
+                    size_t first, size_t last, char* failed) {
+      try {
+        OurReader reader(*features);
+        for (size_t i = first; i < last; ++i) {
+          if (!reader.parseElement(beginDoc, elements[i].begin_,
+                                   elements[i].end_, *slots[i])) {
+            *failed = 1;
+            return;
+          }
+        }
+      } catch (...) {
+        *failed = 1;
+      }
+    }
+  };
+  std::vector<std::thread> pool;
+  try {
+    // reserved up front, so a push_back never drops a running thread
+    pool.reserve(workers - 1);
+    for (unsigned w = 1; w < workers; ++w)
+      pool.push_back(std::thread(&Worker::run, &features, beginDoc,
+                                 &elements[0], &slots[0], firsts[w],
+                                 firsts[w + 1], &failed[w]));
+  } catch (...) {
+    // a thread could not be started: wait for the others and let the caller
+    // parse the document serially.
+    for (size_t w = 0; w < pool.size(); ++w)
+      pool[w].join();
+    return false;
+  }
+  Worker::run(&features, beginDoc, &elements[0], &slots[0], firsts[0],
+              firsts[1], &failed[0]);
+  for (size_t w = 0; w < pool.size(); ++w)
+    pool[w].join();
+  for (unsigned w = 0; w < workers; ++w) {
+    if (failed[w])
+      return false;
+  }
+  root.swapPayload(array);
+  root.setOffsetStart(arrayBegin - beginDoc);
+  root.setOffsetLimit(arrayEnd - beginDoc);
+  return true;
+}
+
 class OurCharReader : public CharReader {
   bool const collectComments_;
+  OurFeatures const features_;
+  unsigned const parallelThreads_;
+  size_t const parallelMinSize_;
   OurReader reader_;
 public:
   OurCharReader(
     bool collectComments,
-    OurFeatures const& features)
+    OurFeatures const& features,
+    unsigned parallelThreads,
+    size_t parallelMinSize)
   : collectComments_(collectComments)
+  , features_(features)
+  , parallelThreads_(parallelThreads)
+  , parallelMinSize_(parallelMinSize)
   , reader_(features)
   {}
   bool parse(
       char const* beginDoc, char const* endDoc,
       Value* root, JSONCPP_STRING* errs) JSONCPP_OVERRIDE {
+    if (parallelThreads_ > 1 &&
+        static_cast<size_t>(endDoc - beginDoc) >= parallelMinSize_ &&
+        parseArrayInParallel(features_, parallelThreads_, beginDoc, endDoc, *root)) {
+      if (errs) {
+        errs->clear();
+      }
+      return true;
+    }
     bool ok = reader_.parse(beginDoc, endDoc, *root, collectComments_);
     if (errs) {
       *errs = reader_.getFormattedErrorMessages();
@@ -2189,7 +2397,13 @@ CharReader* CharReaderBuilder::newCharReader() const
   features.failIfExtra_ = settings_["failIfExtra"].asBool();
   features.rejectDupKeys_ = settings_["rejectDupKeys"].asBool();
   features.allowSpecialFloats_ = settings_["allowSpecialFloats"].asBool();
-  return new OurCharReader(collectComments, features);
+  features.internKeys_ = settings_["internKeys"].asBool();
+  int parallelThreads = settings_["parallelArrayThreads"].asInt();
+  if (parallelThreads < 0)
+    parallelThreads = static_cast<int>(std::thread::hardware_concurrency());
+  return new OurCharReader(collectComments, features,
+                           static_cast<unsigned>(parallelThreads),
+                           settings_["parallelArrayMinSize"].asLargestUInt());
 }
 static void getValidReaderKeys(std::set<JSONCPP_STRING>* valid_keys)
 {
@@ -2204,6 +2418,9 @@ static void getValidReaderKeys(std::set<JSONCPP_STRING>* valid_keys)
   valid_keys->insert("failIfExtra");
   valid_keys->insert("rejectDupKeys");
   valid_keys->insert("allowSpecialFloats");
+  valid_keys->insert("internKeys");
+  valid_keys->insert("parallelArrayThreads");
+  valid_keys->insert("parallelArrayMinSize");
 }
 bool CharReaderBuilder::validate(Json::Value* invalid) const
 {
@@ -2239,6 +2456,7 @@ void CharReaderBuilder::strictMode(Json::Value* settings)
   (*settings)["failIfExtra"] = true;
   (*settings)["rejectDupKeys"] = true;
   (*settings)["allowSpecialFloats"] = false;
+  (*settings)["internKeys"] = false;
 //! [CharReaderBuilderStrictMode]
 }
 // static
@@ -2255,9 +2473,385 @@ void CharReaderBuilder::setDefaults(Json::Value* settings)
   (*settings)["failIfExtra"] = false;
   (*settings)["rejectDupKeys"] = false;
   (*settings)["allowSpecialFloats"] = false;
+  (*settings)["internKeys"] = false;
+  (*settings)["parallelArrayThreads"] = 0;
+  (*settings)["parallelArrayMinSize"] = 1 << 20;
 //! [CharReaderBuilderDefaults]
 }
 
+//////////////////////////////////
+// CBOR
+
+class CborCharReader : public CharReader {
+public:
+  CborCharReader(bool referenceKeys,
+                 bool internKeys,
+                 int stackLimit,
+                 bool failIfExtra);
+  bool parse(
+      char const* beginDoc, char const* endDoc,
+      Value* root, JSONCPP_STRING* errs) JSONCPP_OVERRIDE;
+
+private:
+  typedef unsigned char Byte;
+  enum { indefiniteLength = 31, breakByte = 0xff };
+
+  bool readHead(unsigned& major, unsigned& info, LargestUInt& argument);
+  bool readValue(Value& value, int depth);
+  bool readArray(Value& value, unsigned info, LargestUInt argument, int depth);
+  bool readObject(Value& value, unsigned info, LargestUInt argument, int depth);
+  bool readString(unsigned major,
+                  unsigned info,
+                  LargestUInt argument,
+                  char const** begin,
+                  char const** end);
+  bool readSimple(Value& value, unsigned info, LargestUInt argument);
+  bool isBreak();
+  bool addError(const JSONCPP_STRING& message);
+
+  static double decodeHalf(unsigned half);
+
+  bool const referenceKeys_;
+  bool const internKeys_;
+  int const stackLimit_;
+  bool const failIfExtra_;
+  Byte const* begin_;
+  Byte const* end_;
+  Byte const* current_;
+  Byte const* errorAt_;
+  JSONCPP_STRING error_;
+  JSONCPP_STRING chunks_; // indefinite length string being reassembled
+};
+
+CborCharReader::CborCharReader(bool referenceKeys,
+                               bool internKeys,
+                               int stackLimit,
+                               bool failIfExtra)
+    : referenceKeys_(referenceKeys), internKeys_(internKeys),
+      stackLimit_(stackLimit), failIfExtra_(failIfExtra), begin_(), end_(),
+      current_(), errorAt_(), error_(), chunks_() {}
+
+bool CborCharReader::parse(char const* beginDoc, char const* endDoc,
+                           Value* root, JSONCPP_STRING* errs) {
+  begin_ = reinterpret_cast<Byte const*>(beginDoc);
+  end_ = reinterpret_cast<Byte const*>(endDoc);
+  current_ = begin_;
+  errorAt_ = NULL;
+  error_.clear();
+  bool ok = readValue(*root, 0);
+  if (ok && failIfExtra_ && current_ != end_)
+    ok = addError("Extra bytes after CBOR value.");
+  if (errs) {
+    errs->clear();
+    if (!ok) {
+      JSONCPP_OSTRINGSTREAM oss;
+      oss << "* Offset " << (errorAt_ - begin_) << "\n  " << error_ << "\n";
+      *errs = oss.str();
+    }
+  }
+  return ok;
+}
+
+bool CborCharReader::addError(const JSONCPP_STRING& message) {
+  errorAt_ = current_;
+  error_ = message;
+  return false;
+}
+
+bool CborCharReader::isBreak() {
+  if (current_ != end_ && *current_ == breakByte) {
+    ++current_;
+    return true;
+  }
+  return false;
+}
+
+bool CborCharReader::readHead(unsigned& major,
+                              unsigned& info,
+                              LargestUInt& argument) {
+  if (current_ == end_)
+    return addError("Unexpected end of CBOR input.");
+  Byte initial = *current_++;
+  major = initial >> 5;
+  info = initial & 0x1f;
+  argument = 0;
+  if (info < 24)
+    argument = info;
+  else if (info <= 27) {
+    size_t size = size_t(1) << (info - 24);
+    if (size > static_cast<size_t>(end_ - current_))
+      return addError("Unexpected end of CBOR input.");
+    for (size_t i = 0; i < size; ++i)
+      argument = (argument << 8) | *current_++;
+  } else if (info != indefiniteLength || major == 0 || major == 1 ||
+             major == 6) {
+    --current_;
+    return addError("Invalid CBOR additional information.");
+  }
+  return true;
+}
+
+bool CborCharReader::readValue(Value& value, int depth) {
+  if (depth > stackLimit_)
+    throwRuntimeError("Exceeded stackLimit in readValue().");
+  unsigned major;
+  unsigned info;
+  LargestUInt argument;
+  if (!readHead(major, info, argument))
+    return false;
+  switch (major) {
+  case 0: {
+    Value decoded = argument <= LargestUInt(Value::maxLargestInt)
+                        ? Value(LargestInt(argument))
+                        : Value(argument);
+    value.swapPayload(decoded);
+    return true;
+  }
+  case 1: {
+    if (argument > LargestUInt(Value::maxLargestInt))
+      return addError("CBOR negative integer out of range.");
+    Value decoded(-LargestInt(argument) - 1);
+    value.swapPayload(decoded);
+    return true;
+  }
+  case 2:
+  case 3: {
+    char const* begin;
+    char const* end;
+    if (!readString(major, info, argument, &begin, &end))
+      return false;
+    Value decoded(begin, end);
+    value.swapPayload(decoded);
+    return true;
+  }
+  case 4:
+    return readArray(value, info, argument, depth);
+  case 5:
+    return readObject(value, info, argument, depth);
+  case 6:
+    if (!readValue(value, depth + 1))
+      return false;
+    if (argument == JSONCPP_CBOR_UINT_TAG && value.type() == intValue &&
+        value.asLargestInt() >= 0) {
+      Value decoded(value.asLargestUInt());
+      value.swapPayload(decoded);
+    }
+    return true;
+  default:
+    return readSimple(value, info, argument);
+  }
+}
+
+bool CborCharReader::readArray(Value& value,
+                               unsigned info,
+                               LargestUInt argument,
+                               int depth) {
+  Value init(arrayValue);
+  value.swapPayload(init);
+  if (info == indefiniteLength) {
+    for (ArrayIndex index = 0; !isBreak(); ++index) {
+      if (!readValue(value[index], depth + 1))
+        return false;
+    }
+    return true;
+  }
+  // Each element takes at least one byte.
+  if (argument > static_cast<LargestUInt>(end_ - current_))
+    return addError("CBOR array length exceeds the input.");
+  for (ArrayIndex index = 0; index < argument; ++index) {
+    if (!readValue(value[index], depth + 1))
+      return false;
+  }
+  return true;
+}
+
+bool CborCharReader::readObject(Value& value,
+                                unsigned info,
+                                LargestUInt argument,
+                                int depth) {
+  Value init(objectValue);
+  value.swapPayload(init);
+  bool indefinite = info == indefiniteLength;
+  // Each member takes at least two bytes.
+  if (!indefinite && argument > static_cast<LargestUInt>(end_ - current_) / 2)
+    return addError("CBOR map length exceeds the input.");
+  for (LargestUInt i = 0; indefinite || i < argument; ++i) {
+    if (indefinite && isBreak())
+      break;
+    unsigned major;
+    unsigned keyInfo;
+    LargestUInt keyArgument;
+    if (!readHead(major, keyInfo, keyArgument))
+      return false;
+    if (major != 2 && major != 3)
+      return addError("CBOR map key must be a string.");
+    char const* begin;
+    char const* end;
+    if (!readString(major, keyInfo, keyArgument, &begin, &end))
+      return false;
+    if (end - begin >= (1 << 30))
+      throwRuntimeError("keylength >= 2^30");
+    char const* interned =
+        internKeys_ ? KeyInternTable::find(begin, end) : NULL;
+    Value* member;
+    if (interned)
+      member = &value.resolveStaticReference(interned, interned + (end - begin));
+    else if (referenceKeys_ && keyInfo != indefiniteLength &&
+             reinterpret_cast<Byte const*>(end) < end_ && *end == '\0')
+      // Only names terminated in the input are referenced, so that they
+      // stay C strings (see memberName()); the others are copied.
+      member = &value.resolveStaticReference(begin, end);
+    else
+      member = &value.resolveReference(begin, end);
+    if (!readValue(*member, depth + 1))
+      return false;
+  }
+  return true;
+}
+
+// On success, [begin, end) points into the input, or into chunks_ for an
+// indefinite length string (valid until the next string is read).
+bool CborCharReader::readString(unsigned major,
+                                unsigned info,
+                                LargestUInt argument,
+                                char const** begin,
+                                char const** end) {
+  if (info != indefiniteLength) {
+    if (argument > static_cast<LargestUInt>(end_ - current_))
+      return addError("CBOR string length exceeds the input.");
+    *begin = reinterpret_cast<char const*>(current_);
+    current_ += argument;
+    *end = reinterpret_cast<char const*>(current_);
+    return true;
+  }
+  chunks_.clear();
+  while (!isBreak()) {
+    unsigned chunkMajor;
+    unsigned chunkInfo;
+    LargestUInt chunkLength;
+    if (!readHead(chunkMajor, chunkInfo, chunkLength))
+      return false;
+    if (chunkMajor != major || chunkInfo == indefiniteLength)
+      return addError("Invalid chunk in CBOR indefinite length string.");
+    if (chunkLength > static_cast<LargestUInt>(end_ - current_))
+      return addError("CBOR string length exceeds the input.");
+    chunks_.append(reinterpret_cast<char const*>(current_),
+                   static_cast<size_t>(chunkLength));
+    current_ += chunkLength;
+  }
+  *begin = chunks_.data();
+  *end = chunks_.data() + chunks_.length();
+  return true;
+}
+
+bool CborCharReader::readSimple(Value& value,
+                                unsigned info,
+                                LargestUInt argument) {
+  Value decoded;
+  switch (info) {
+  case 20:
+    decoded = false;
+    break;
+  case 21:
+    decoded = true;
+    break;
+  case 22: // null
+  case 23: // undefined
+    break;
+  case 25:
+    decoded = decodeHalf(static_cast<unsigned>(argument));
+    break;
+  case 26: {
+    UInt bits = static_cast<UInt>(argument);
+    float single;
+    memcpy(&single, &bits, sizeof(single));
+    decoded = static_cast<double>(single);
+    break;
+  }
+  case 27: {
+    UInt64 bits = static_cast<UInt64>(argument);
+    double real;
+    memcpy(&real, &bits, sizeof(real));
+    decoded = real;
+    break;
+  }
+  case indefiniteLength:
+    --current_;
+    return addError("Unexpected CBOR break.");
+  default:
+    --current_;
+    return addError("Unsupported CBOR simple value.");
+  }
+  value.swapPayload(decoded);
+  return true;
+}
+
+double CborCharReader::decodeHalf(unsigned half) {
+  int exponent = static_cast<int>((half >> 10) & 0x1f);
+  unsigned mantissa = half & 0x3ff;
+  double real;
+  if (exponent == 0)
+    real = std::ldexp(static_cast<double>(mantissa), -24);
+  else if (exponent != 31)
+    real = std::ldexp(static_cast<double>(mantissa + 1024), exponent - 25);
+  else if (mantissa == 0)
+    real = std::numeric_limits<double>::infinity();
+  else
+    real = std::numeric_limits<double>::quiet_NaN();
+  return (half & 0x8000) ? -real : real;
+}
+
+CborCharReaderBuilder::CborCharReaderBuilder()
+{
+  setDefaults(&settings_);
+}
+CborCharReaderBuilder::~CborCharReaderBuilder()
+{}
+CharReader* CborCharReaderBuilder::newCharReader() const
+{
+  return new CborCharReader(settings_["referenceKeys"].asBool(),
+                            settings_["internKeys"].asBool(),
+                            settings_["stackLimit"].asInt(),
+                            settings_["failIfExtra"].asBool());
+}
+static void getValidCborReaderKeys(std::set<JSONCPP_STRING>* valid_keys)
+{
+  valid_keys->clear();
+  valid_keys->insert("referenceKeys");
+  valid_keys->insert("internKeys");
+  valid_keys->insert("stackLimit");
+  valid_keys->insert("failIfExtra");
+}
+bool CborCharReaderBuilder::validate(Json::Value* invalid) const
+{
+  Json::Value my_invalid;
+  if (!invalid) invalid = &my_invalid;  // so we do not need to test for NULL
+  Json::Value& inv = *invalid;
+  std::set<JSONCPP_STRING> valid_keys;
+  getValidCborReaderKeys(&valid_keys);
+  Value::Members keys = settings_.getMemberNames();
+  size_t n = keys.size();
+  for (size_t i = 0; i < n; ++i) {
+    JSONCPP_STRING const& key = keys[i];
+    if (valid_keys.find(key) == valid_keys.end()) {
+      inv[key] = settings_[key];
+    }
+  }
+  return 0u == inv.size();
+}
+Value& CborCharReaderBuilder::operator[](JSONCPP_STRING key)
+{
+  return settings_[key];
+}
+// static
+void CborCharReaderBuilder::setDefaults(Json::Value* settings)
+{
+  (*settings)["referenceKeys"] = false;
+  (*settings)["internKeys"] = false;
+  (*settings)["stackLimit"] = 1000;
+  (*settings)["failIfExtra"] = true;
+}
+
 //////////////////////////////////
 // global functions
 
@@ -2380,8 +2974,7 @@ void ValueIteratorBase::copy(const SelfType& other) {
 Value ValueIteratorBase::key() const {
   const Value::CZString czstring = (*current_).first;
   if (czstring.data()) {
-    if (czstring.isStaticString())
-      return Value(StaticString(czstring.data()));
+    // Names may contain embedded nulls, so always copy length bytes.
     return Value(czstring.data(), czstring.data() + czstring.length());
   }
   return Value(czstring.index());
@@ -2501,9 +3094,17 @@ ValueIterator& ValueIterator::operator=(const SelfType& other) {
 #endif
 #include <cstddef> // size_t
 #include <algorithm> // min()
+#include <atomic>
+#include <mutex>
 
 #define JSON_ASSERT_UNREACHABLE assert(false)
 
+// Define JSONCPP_KEY_INTERN_CAPACITY as a power of two at compile time to change
+// the number of slots of the KeyInternTable.
+#if !defined(JSONCPP_KEY_INTERN_CAPACITY)
+#define JSONCPP_KEY_INTERN_CAPACITY 1024
+#endif
+
 namespace Json {
 
 // This is a walkaround to avoid the static initialization of Value::null.
@@ -2572,6 +3173,59 @@ static inline bool InRange(double d, T min, U max) {
 }
 #endif // if !defined(JSON_USE_INT64_DOUBLE_CONVERSION)
 
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+// class AllocationStats
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+
+#if JSONCPP_ALLOCATION_STATS
+// Relaxed ordering: the counters are statistics, not synchronisation.
+static std::atomic<LargestUInt> allocationCount(0);
+static std::atomic<LargestUInt> releaseCount(0);
+static std::atomic<LargestUInt> bytesInUse(0);
+
+void countAllocation(size_t bytes) {
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  bytesInUse.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void countRelease(size_t bytes) {
+  releaseCount.fetch_add(1, std::memory_order_relaxed);
+  bytesInUse.fetch_sub(bytes, std::memory_order_relaxed);
+}
+#endif // if JSONCPP_ALLOCATION_STATS
+
+static inline void recordAllocation(size_t bytes) {
+#if JSONCPP_ALLOCATION_STATS
+  countAllocation(bytes);
+#else
+  (void)bytes;
+#endif
+}
+
+static inline void recordRelease(size_t bytes) {
+#if JSONCPP_ALLOCATION_STATS
+  countRelease(bytes);
+#else
+  (void)bytes;
+#endif
+}
+
+AllocationStats AllocationStats::current() {
+  AllocationStats stats;
+#if JSONCPP_ALLOCATION_STATS
+  stats.allocations_ = allocationCount.load(std::memory_order_relaxed);
+  stats.releases_ = releaseCount.load(std::memory_order_relaxed);
+  stats.bytesInUse_ = bytesInUse.load(std::memory_order_relaxed);
+#else
+  stats.allocations_ = stats.releases_ = stats.bytesInUse_ = 0;
+#endif
+  return stats;
+}
+
 /** Duplicates the specified string value.
  * @param value Pointer to the string to duplicate. Must be zero-terminated if
  *              length is "unknown".
@@ -2593,6 +3247,7 @@ static inline char* duplicateStringValue(const char* value,
         "in Json::Value::duplicateStringValue(): "
         "Failed to allocate string value buffer");
   }
+  recordAllocation(length + 1);
   memcpy(newString, value, length);
   newString[length] = 0;
   return newString;
@@ -2616,6 +3271,7 @@ static inline char* duplicateAndPrefixStringValue(
         "in Json::Value::duplicateAndPrefixStringValue(): "
         "Failed to allocate string value buffer");
   }
+  recordAllocation(actualLength);
   *reinterpret_cast<unsigned*>(newString) = length;
   memcpy(newString + sizeof(unsigned), value, length);
   newString[actualLength - 1U] = 0; // to avoid buffer over-run accidents by users later
@@ -2641,20 +3297,25 @@ static inline void releasePrefixedStringValue(char* value) {
   char const* valueDecoded;
   decodePrefixedString(true, value, &length, &valueDecoded);
   size_t const size = sizeof(unsigned) + length + 1U;
+  recordRelease(size);
   memset(value, 0, size);
   free(value);
 }
 static inline void releaseStringValue(char* value, unsigned length) {
   // length==0 => we allocated the strings memory
   size_t size = (length==0) ? strlen(value) : length;
+  recordRelease(length == 0 ? size + 1 : size);
   memset(value, 0, size);
   free(value);
 }
 #else // !JSONCPP_USING_SECURE_MEMORY
 static inline void releasePrefixedStringValue(char* value) {
+  recordRelease(sizeof(unsigned) + *reinterpret_cast<unsigned const*>(value) + 1U);
   free(value);
 }
-static inline void releaseStringValue(char* value, unsigned) {
+static inline void releaseStringValue(char* value, unsigned length) {
+  // length==0 => we allocated the strings memory
+  recordRelease(length == 0 ? strlen(value) + 1 : length);
   free(value);
 }
 #endif // JSONCPP_USING_SECURE_MEMORY
@@ -2798,6 +3459,8 @@ bool Value::CZString::operator<(const CZString& other) const {
   // Assume both are strings.
   unsigned this_len = this->storage_.length_;
   unsigned other_len = other.storage_.length_;
+  // Shared (e.g. interned) names need no memcmp.
+  if (this->cstr_ == other.cstr_ && this_len == other_len) return false;
   unsigned min_len = std::min<unsigned>(this_len, other_len);
   JSON_ASSERT(this->cstr_ && other.cstr_);
   int comp = memcmp(this->cstr_, other.cstr_, min_len);
@@ -2813,6 +3476,7 @@ bool Value::CZString::operator==(const CZString& other) const {
   unsigned this_len = this->storage_.length_;
   unsigned other_len = other.storage_.length_;
   if (this_len != other_len) return false;
+  if (this->cstr_ == other.cstr_) return true;
   JSON_ASSERT(this->cstr_ && other.cstr_);
   int comp = memcmp(this->cstr_, other.cstr_, this_len);
   return comp == 0;
@@ -2825,6 +3489,104 @@ const char* Value::CZString::data() const { return cstr_; }
 unsigned Value::CZString::length() const { return storage_.length_; }
 bool Value::CZString::isStaticString() const { return storage_.policy_ == noDuplication; }
 
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+// class KeyInternTable
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+
+// Open addressing with linear probing. Entries are published with a release
+// store once fully written, so readers only need an acquire load. Entries are
+// never removed nor released.
+namespace {
+struct InternedKey {
+  unsigned hash_;
+  unsigned length_;
+  char name_[1]; // actually length_ + 1 bytes
+};
+static unsigned const internCapacity = JSONCPP_KEY_INTERN_CAPACITY;
+static std::atomic<InternedKey const*> internSlots[internCapacity];
+static std::atomic<unsigned> internCount(0);
+static std::mutex internMutex;
+
+InternedKey const* findInterned(char const* begin, unsigned length, unsigned h) {
+  for (unsigned i = 0; i < internCapacity; ++i) {
+    InternedKey const* key =
+        internSlots[(h + i) & (internCapacity - 1)].load(std::memory_order_acquire);
+    if (!key)
+      return NULL;
+    if (key->hash_ == h && key->length_ == length &&
+        memcmp(key->name_, begin, length) == 0)
+      return key;
+  }
+  return NULL;
+}
+} // namespace
+
+unsigned KeyInternTable::hash(char const* begin, char const* end) {
+  // FNV-1a
+  unsigned h = 2166136261u;
+  for (; begin != end; ++begin)
+    h = (h ^ static_cast<unsigned char>(*begin)) * 16777619u;
+  return h;
+}
+
+char const* KeyInternTable::find(char const* begin, char const* end) {
+  unsigned length = static_cast<unsigned>(end - begin);
+  InternedKey const* key = findInterned(begin, length, hash(begin, end));
+  return key ? key->name_ : NULL;
+}
+
+char const* KeyInternTable::intern(char const* begin, char const* end) {
+  unsigned h = hash(begin, end);
+  unsigned length = static_cast<unsigned>(end - begin);
+  InternedKey const* key = findInterned(begin, length, h);
+  if (key)
+    return key->name_;
+  if (memchr(begin, 0, length) != NULL)
+    return NULL;
+  std::lock_guard<std::mutex> lock(internMutex);
+  // Keep the load factor at 1/2 so that probing stays short.
+  if (internCount.load(std::memory_order_relaxed) >= internCapacity / 2)
+    return NULL;
+  for (unsigned i = 0; i < internCapacity; ++i) {
+    std::atomic<InternedKey const*>& slot = internSlots[(h + i) & (internCapacity - 1)];
+    InternedKey const* current = slot.load(std::memory_order_relaxed);
+    if (current) {
+      // Another thread may have added it since we looked.
+      if (current->hash_ == h && current->length_ == length &&
+          memcmp(current->name_, begin, length) == 0)
+        return current->name_;
+      continue;
+    }
+    InternedKey* added = static_cast<InternedKey*>(
+        malloc(sizeof(InternedKey) + length));
+    if (added == NULL) {
+      throwRuntimeError(
+          "in Json::KeyInternTable::intern(): "
+          "Failed to allocate interned key");
+    }
+    added->hash_ = h;
+    added->length_ = length;
+    memcpy(added->name_, begin, length);
+    added->name_[length] = 0;
+    slot.store(added, std::memory_order_release);
+    internCount.fetch_add(1, std::memory_order_relaxed);
+    return added->name_;
+  }
+  return NULL;
+}
+
+char const* KeyInternTable::intern(char const* key) {
+  return intern(key, key + strlen(key));
+}
+
+ArrayIndex KeyInternTable::size() {
+  return internCount.load(std::memory_order_relaxed);
+}
+
 // //////////////////////////////////////////////////////////////////
 // //////////////////////////////////////////////////////////////////
 // //////////////////////////////////////////////////////////////////
@@ -2857,6 +3619,7 @@ Value::Value(ValueType vtype) {
   case arrayValue:
   case objectValue:
     value_.map_ = new ObjectValues();
+    recordAllocation(sizeof(ObjectValues));
     break;
   case booleanValue:
     value_.bool_ = false;
@@ -2942,6 +3705,8 @@ Value::Value(Value&& other) {
 Value::~Value() {
   releasePayload();
 
+  if (comments_)
+    recordRelease(sizeof(CommentInfo) * numberOfCommentPlacement);
   delete[] comments_;
 
   value_.uint_ = 0;
@@ -2976,6 +3741,8 @@ void Value::swap(Value& other) {
 
 void Value::copy(const Value& other) {
   copyPayload(other);
+  if (comments_)
+    recordRelease(sizeof(CommentInfo) * numberOfCommentPlacement);
   delete[] comments_;
   dupMeta(other);
 }
@@ -3502,6 +4269,7 @@ void Value::dupPayload(const Value& other) {
   case arrayValue:
   case objectValue:
     value_.map_ = new ObjectValues(*other.value_.map_);
+    recordAllocation(sizeof(ObjectValues));
     break;
   default:
     JSON_ASSERT_UNREACHABLE;
@@ -3522,6 +4290,7 @@ void Value::releasePayload() {
     break;
   case arrayValue:
   case objectValue:
+    recordRelease(sizeof(ObjectValues));
     delete value_.map_;
     break;
   default:
@@ -3532,6 +4301,7 @@ void Value::releasePayload() {
 void Value::dupMeta(const Value& other) {
   if (other.comments_) {
     comments_ = new CommentInfo[numberOfCommentPlacement];
+    recordAllocation(sizeof(CommentInfo) * numberOfCommentPlacement);
     for (int comment = 0; comment < numberOfCommentPlacement; ++comment) {
       const CommentInfo& otherComment = other.comments_[comment];
       if (otherComment.comment_)
@@ -3586,6 +4356,26 @@ Value& Value::resolveReference(char const* key, char const* cend)
   return value;
 }
 
+// @param key is not null-terminated, and must outlive this value and its copies.
+Value& Value::resolveStaticReference(char const* key, char const* cend)
+{
+  JSON_ASSERT_MESSAGE(
+      type_ == nullValue || type_ == objectValue,
+      "in Json::Value::resolveStaticReference(key, end): requires objectValue");
+  if (type_ == nullValue)
+    *this = Value(objectValue);
+  CZString actualKey(
+      key, static_cast<unsigned>(cend-key), CZString::noDuplication);
+  ObjectValues::iterator it = value_.map_->lower_bound(actualKey);
+  if (it != value_.map_->end() && (*it).first == actualKey)
+    return (*it).second;
+
+  ObjectValues::value_type defaultValue(actualKey, nullSingleton());
+  it = value_.map_->insert(it, defaultValue);
+  Value& value = (*it).second;
+  return value;
+}
+
 Value Value::get(ArrayIndex index, const Value& defaultValue) const {
   const Value* value = &((*this)[index]);
   return value == &nullSingleton() ? defaultValue : *value;
@@ -3917,8 +4707,10 @@ bool Value::isArray() const { return type_ == arrayValue; }
 bool Value::isObject() const { return type_ == objectValue; }
 
 void Value::setComment(const char* comment, size_t len, CommentPlacement placement) {
-  if (!comments_)
+  if (!comments_) {
     comments_ = new CommentInfo[numberOfCommentPlacement];
+    recordAllocation(sizeof(CommentInfo) * numberOfCommentPlacement);
+  }
   if ((len > 0) && (comment[len-1] == '\n')) {
     // Always discard trailing newline, to aid indentation.
     len -= 1;
@@ -3962,6 +4754,80 @@ JSONCPP_STRING Value::toStyledString() const {
   return out;
 }
 
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+// class MemoryUsage
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+
+MemoryUsage::MemoryUsage() {
+  Category const empty = { 0, 0 };
+  strings_ = keys_ = objects_ = arrays_ = comments_ = empty;
+}
+
+LargestUInt MemoryUsage::bytes() const {
+  return strings_.bytes_ + keys_.bytes_ + objects_.bytes_ + arrays_.bytes_ +
+         comments_.bytes_;
+}
+
+LargestUInt MemoryUsage::allocations() const {
+  return strings_.allocations_ + keys_.allocations_ + objects_.allocations_ +
+         arrays_.allocations_ + comments_.allocations_;
+}
+
+MemoryUsage Value::memoryUsage() const {
+  MemoryUsage usage;
+  addMemoryUsage(usage);
+  return usage;
+}
+
+void Value::addMemoryUsage(MemoryUsage& usage) const {
+  if (comments_) {
+    usage.comments_.bytes_ += sizeof(CommentInfo) * numberOfCommentPlacement;
+    ++usage.comments_.allocations_;
+    for (int comment = 0; comment < numberOfCommentPlacement; ++comment) {
+      if (comments_[comment].comment_) {
+        usage.comments_.bytes_ += strlen(comments_[comment].comment_) + 1;
+        ++usage.comments_.allocations_;
+      }
+    }
+  }
+  switch (type_) {
+  case stringValue:
+    if (allocated_) {
+      unsigned len;
+      char const* str;
+      decodePrefixedString(true, value_.string_, &len, &str);
+      usage.strings_.bytes_ += sizeof(unsigned) + len + 1U;
+      ++usage.strings_.allocations_;
+    }
+    break;
+  case arrayValue:
+  case objectValue: {
+    // A red-black tree node is the stored pair plus colour, parent and
+    // children pointers; count four pointers for the bookkeeping.
+    size_t const nodeSize = sizeof(ObjectValues::value_type) + 4 * sizeof(void*);
+    MemoryUsage::Category& container =
+        type_ == arrayValue ? usage.arrays_ : usage.objects_;
+    container.bytes_ += sizeof(ObjectValues) + value_.map_->size() * nodeSize;
+    container.allocations_ += 1 + value_.map_->size();
+    ObjectValues::const_iterator it = value_.map_->begin();
+    ObjectValues::const_iterator itEnd = value_.map_->end();
+    for (; it != itEnd; ++it) {
+      if (it->first.data() && !it->first.isStaticString()) {
+        usage.keys_.bytes_ += it->first.length() + 1;
+        ++usage.keys_.allocations_;
+      }
+      it->second.addMemoryUsage(usage);
+    }
+  } break;
+  default:
+    break;
+  }
+}
+
 Value::const_iterator Value::begin() const {
   switch (type_) {
   case arrayValue:
@@ -4159,6 +5025,265 @@ Value& Path::make(Value& root) const {
   return *node;
 }
 
+// class PathQuery
+// //////////////////////////////////////////////////////////////////
+
+PathQuery::PathQuery() : keys_(), steps_(), valid_(true) {}
+
+PathQuery::PathQuery(const JSONCPP_STRING& path)
+    : keys_(), steps_(), valid_(false) {
+  valid_ = compile(path, keys_, steps_);
+}
+
+bool PathQuery::compile(const JSONCPP_STRING& path,
+                        JSONCPP_STRING& keys,
+                        Steps& steps) {
+  const char* current = path.c_str();
+  const char* end = current + path.length();
+  while (current != end) {
+    Step s;
+    s.index_ = 0;
+    s.length_ = 0;
+    if (*current == '[') {
+      ++current;
+      if (current != end && *current == '*') {
+        s.kind_ = kindAnyIndex;
+        ++current;
+      } else {
+        if (current == end || *current < '0' || *current > '9')
+          return false;
+        s.kind_ = kindIndex;
+        for (; current != end && *current >= '0' && *current <= '9'; ++current) {
+          ArrayIndex digit = ArrayIndex(*current - '0');
+          // An index that doesn't fit ArrayIndex would wrap to another one.
+          if (s.index_ > (ArrayIndex(-1) - digit) / 10)
+            return false;
+          s.index_ = s.index_ * 10 + digit;
+        }
+      }
+      if (current == end || *current != ']')
+        return false;
+      ++current;
+    } else if (*current == '.') {
+      ++current;
+      continue;
+    } else {
+      const char* beginName = current;
+      while (current != end && *current != '[' && *current != '.')
+        ++current;
+      if (current - beginName == 1 && *beginName == '*') {
+        s.kind_ = kindAnyKey;
+      } else {
+        s.kind_ = kindKey;
+        s.index_ = ArrayIndex(keys.length());
+        s.length_ = static_cast<unsigned>(current - beginName);
+        keys.append(beginName, current);
+      }
+    }
+    steps.push_back(s);
+  }
+  return true;
+}
+
+const Value* PathQuery::step(const Value& node,
+                             const Step& s,
+                             const JSONCPP_STRING& keys) {
+  switch (s.kind_) {
+  case kindIndex:
+    if (!node.isArray() || !node.isValidIndex(s.index_))
+      return NULL;
+    return &node[s.index_];
+  case kindKey: {
+    if (!node.isObject())
+      return NULL;
+    char const* key = keys.data() + s.index_;
+    return node.find(key, key + s.length_);
+  }
+  default:
+    return NULL;
+  }
+}
+
+const Value* PathQuery::resolveFrom(const Value& node, size_t first) const {
+  const Value* current = &node;
+  for (size_t i = first; i < steps_.size(); ++i) {
+    const Step& s = steps_[i];
+    if (s.kind_ == kindAnyIndex || s.kind_ == kindAnyKey) {
+      if (!(s.kind_ == kindAnyIndex ? current->isArray() : current->isObject()))
+        return NULL;
+      Value::const_iterator itEnd = current->end();
+      for (Value::const_iterator it = current->begin(); it != itEnd; ++it) {
+        const Value* found = resolveFrom(*it, i + 1);
+        if (found)
+          return found;
+      }
+      return NULL;
+    }
+    current = step(*current, s, keys_);
+    if (!current)
+      return NULL;
+  }
+  return current;
+}
+
+void PathQuery::collectFrom(const Value& node,
+                            size_t first,
+                            const Value** results,
+                            ArrayIndex maxResults,
+                            ArrayIndex& found) const {
+  const Value* current = &node;
+  for (size_t i = first; i < steps_.size(); ++i) {
+    const Step& s = steps_[i];
+    if (s.kind_ == kindAnyIndex || s.kind_ == kindAnyKey) {
+      if (!(s.kind_ == kindAnyIndex ? current->isArray() : current->isObject()))
+        return;
+      Value::const_iterator itEnd = current->end();
+      for (Value::const_iterator it = current->begin(); it != itEnd; ++it)
+        collectFrom(*it, i + 1, results, maxResults, found);
+      return;
+    }
+    current = step(*current, s, keys_);
+    if (!current)
+      return;
+  }
+  if (found < maxResults)
+    results[found] = current;
+  ++found;
+}
+
+bool PathQuery::isValid() const { return valid_; }
+
+const Value& PathQuery::resolve(const Value& root) const {
+  if (!valid_)
+    return Value::nullSingleton();
+  const Value* found = resolveFrom(root, 0);
+  if (!found)
+    return Value::nullSingleton();
+  return *found;
+}
+
+Value PathQuery::resolve(const Value& root, const Value& defaultValue) const {
+  if (!valid_)
+    return defaultValue;
+  const Value* found = resolveFrom(root, 0);
+  return !found ? defaultValue : *found;
+}
+
+ArrayIndex PathQuery::resolveAll(const Value& root,
+                                 const Value** results,
+                                 ArrayIndex maxResults) const {
+  ArrayIndex found = 0;
+  if (valid_)
+    collectFrom(root, 0, results, maxResults, found);
+  return found;
+}
+
+// class PathQuerySet
+// //////////////////////////////////////////////////////////////////
+
+PathQuerySet::PathQuerySet() : keys_(), nodes_(1), slots_(0) {
+  nodes_[0].step_.kind_ = PathQuery::kindAnyKey;
+  nodes_[0].step_.index_ = 0;
+  nodes_[0].step_.length_ = 0;
+  nodes_[0].firstChild_ = 0;
+  nodes_[0].nextSibling_ = 0;
+  nodes_[0].slot_ = noSlot;
+}
+
+ArrayIndex PathQuerySet::add(const JSONCPP_STRING& path) {
+  JSONCPP_STRING keys;
+  PathQuery::Steps steps;
+  if (!PathQuery::compile(path, keys, steps)) {
+    JSON_FAIL_MESSAGE("in Json::PathQuerySet::add(): invalid path");
+  }
+  ArrayIndex parent = 0;
+  for (size_t i = 0; i < steps.size(); ++i) {
+    PathQuery::Step s = steps[i];
+    ArrayIndex last = 0;
+    ArrayIndex child = nodes_[parent].firstChild_;
+    for (; child != 0; last = child, child = nodes_[child].nextSibling_) {
+      if (isSameStep(nodes_[child].step_, keys_, s, keys))
+        break;
+    }
+    if (child == 0) {
+      if (s.kind_ == PathQuery::kindKey) {
+        ArrayIndex offset = ArrayIndex(keys_.length());
+        keys_.append(keys, s.index_, s.length_);
+        s.index_ = offset;
+      }
+      Node node;
+      node.step_ = s;
+      node.firstChild_ = 0;
+      node.nextSibling_ = 0;
+      node.slot_ = noSlot;
+      child = ArrayIndex(nodes_.size());
+      nodes_.push_back(node);
+      if (last)
+        nodes_[last].nextSibling_ = child;
+      else
+        nodes_[parent].firstChild_ = child;
+    }
+    parent = child;
+  }
+  // The same path added twice shares its slot.
+  if (nodes_[parent].slot_ == noSlot)
+    nodes_[parent].slot_ = slots_++;
+  return nodes_[parent].slot_;
+}
+
+ArrayIndex PathQuerySet::size() const { return slots_; }
+
+void PathQuerySet::resolve(const Value& root, const Value** results) const {
+  for (ArrayIndex i = 0; i < slots_; ++i)
+    results[i] = &Value::nullSingleton();
+  ArrayIndex missing = slots_;
+  if (missing)
+    walk(root, 0, results, missing);
+}
+
+void PathQuerySet::walk(const Value& value,
+                        ArrayIndex node,
+                        const Value** results,
+                        ArrayIndex& missing) const {
+  const Node& n = nodes_[node];
+  if (n.slot_ != noSlot && results[n.slot_] == &Value::nullSingleton()) {
+    results[n.slot_] = &value;
+    --missing;
+  }
+  for (ArrayIndex child = n.firstChild_; child != 0 && missing != 0;
+       child = nodes_[child].nextSibling_) {
+    const PathQuery::Step& s = nodes_[child].step_;
+    if (s.kind_ == PathQuery::kindAnyIndex || s.kind_ == PathQuery::kindAnyKey) {
+      if (!(s.kind_ == PathQuery::kindAnyIndex ? value.isArray() : value.isObject()))
+        continue;
+      Value::const_iterator itEnd = value.end();
+      for (Value::const_iterator it = value.begin(); it != itEnd && missing != 0; ++it)
+        walk(*it, child, results, missing);
+    } else {
+      const Value* next = PathQuery::step(value, s, keys_);
+      if (next)
+        walk(*next, child, results, missing);
+    }
+  }
+}
+
+bool PathQuerySet::isSameStep(const PathQuery::Step& a,
+                              const JSONCPP_STRING& aKeys,
+                              const PathQuery::Step& b,
+                              const JSONCPP_STRING& bKeys) {
+  if (a.kind_ != b.kind_)
+    return false;
+  switch (a.kind_) {
+  case PathQuery::kindIndex:
+    return a.index_ == b.index_;
+  case PathQuery::kindKey:
+    return a.length_ == b.length_ &&
+           memcmp(aKeys.data() + a.index_, bKeys.data() + b.index_, a.length_) == 0;
+  default:
+    return true;
+  }
+}
+
 } // namespace Json
 
 // //////////////////////////////////////////////////////////////////////
@@ -5418,6 +6543,178 @@ void StreamWriterBuilder::setDefaults(Json::Value* settings)
   //! [StreamWriterBuilderDefaults]
 }
 
+//////////////////////////////////
+// CBOR
+
+struct CborStreamWriter : public StreamWriter {
+  CborStreamWriter(bool shortestFloat);
+  int write(Value const& root, JSONCPP_OSTREAM* sout) JSONCPP_OVERRIDE;
+
+private:
+  void writeHead(unsigned major, LargestUInt argument);
+  void writeValue(Value const& value);
+
+  JSONCPP_STRING buffer_;
+  bool shortestFloat_;
+};
+
+CborStreamWriter::CborStreamWriter(bool shortestFloat)
+    : buffer_(), shortestFloat_(shortestFloat) {}
+
+int CborStreamWriter::write(Value const& root, JSONCPP_OSTREAM* sout) {
+  sout_ = sout;
+  buffer_.clear();
+  writeValue(root);
+  sout_->write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+  sout_ = NULL;
+  return 0;
+}
+
+void CborStreamWriter::writeHead(unsigned major, LargestUInt argument) {
+  char head[9];
+  size_t size;
+  major <<= 5;
+  if (argument < 24) {
+    head[0] = static_cast<char>(major | static_cast<unsigned>(argument));
+    size = 1;
+  } else if (argument <= 0xffu) {
+    head[0] = static_cast<char>(major | 24);
+    size = 2;
+  } else if (argument <= 0xffffu) {
+    head[0] = static_cast<char>(major | 25);
+    size = 3;
+  } else if (argument <= 0xffffffffu) {
+    head[0] = static_cast<char>(major | 26);
+    size = 5;
+  } else {
+    head[0] = static_cast<char>(major | 27);
+    size = 9;
+  }
+  for (size_t i = size - 1; i > 0; --i) {
+    head[i] = static_cast<char>(argument & 0xff);
+    argument >>= 8;
+  }
+  buffer_.append(head, size);
+}
+
+void CborStreamWriter::writeValue(Value const& value) {
+  switch (value.type()) {
+  case nullValue:
+    buffer_ += '\xf6';
+    break;
+  case booleanValue:
+    buffer_ += value.asBool() ? '\xf5' : '\xf4';
+    break;
+  case intValue: {
+    LargestInt integer = value.asLargestInt();
+    if (integer >= 0)
+      writeHead(0, LargestUInt(integer));
+    else
+      writeHead(1, LargestUInt(-(integer + 1)));
+    break;
+  }
+  case uintValue: {
+    LargestUInt integer = value.asLargestUInt();
+    if (integer <= LargestUInt(Value::maxLargestInt))
+      writeHead(6, JSONCPP_CBOR_UINT_TAG);
+    writeHead(0, integer);
+    break;
+  }
+  case realValue: {
+    double real = value.asDouble();
+    if (shortestFloat_ &&
+        std::fabs(real) <= std::numeric_limits<float>::max() &&
+        static_cast<double>(static_cast<float>(real)) == real) {
+      float single = static_cast<float>(real);
+      UInt bits;
+      memcpy(&bits, &single, sizeof(bits));
+      buffer_ += '\xfa';
+      for (int shift = 24; shift >= 0; shift -= 8)
+        buffer_ += static_cast<char>((bits >> shift) & 0xff);
+    } else {
+      UInt64 bits;
+      memcpy(&bits, &real, sizeof(bits));
+      buffer_ += '\xfb';
+      for (int shift = 56; shift >= 0; shift -= 8)
+        buffer_ += static_cast<char>((bits >> shift) & 0xff);
+    }
+    break;
+  }
+  case stringValue: {
+    char const* str;
+    char const* end;
+    if (!value.getString(&str, &end)) {
+      writeHead(3, 0);
+      break;
+    }
+    writeHead(3, static_cast<LargestUInt>(end - str));
+    buffer_.append(str, static_cast<size_t>(end - str));
+    break;
+  }
+  case arrayValue: {
+    ArrayIndex size = value.size();
+    writeHead(4, size);
+    for (ArrayIndex index = 0; index < size; ++index)
+      writeValue(value[index]);
+    break;
+  }
+  case objectValue: {
+    writeHead(5, value.size());
+    Value::const_iterator itEnd = value.end();
+    for (Value::const_iterator it = value.begin(); it != itEnd; ++it) {
+      char const* end;
+      char const* name = it.memberName(&end);
+      writeHead(3, static_cast<LargestUInt>(end - name));
+      buffer_.append(name, static_cast<size_t>(end - name));
+      writeValue(*it);
+    }
+    break;
+  }
+  }
+}
+
+CborStreamWriterBuilder::CborStreamWriterBuilder()
+{
+  setDefaults(&settings_);
+}
+CborStreamWriterBuilder::~CborStreamWriterBuilder()
+{}
+StreamWriter* CborStreamWriterBuilder::newStreamWriter() const
+{
+  return new CborStreamWriter(settings_["shortestFloat"].asBool());
+}
+static void getValidCborWriterKeys(std::set<JSONCPP_STRING>* valid_keys)
+{
+  valid_keys->clear();
+  valid_keys->insert("shortestFloat");
+}
+bool CborStreamWriterBuilder::validate(Json::Value* invalid) const
+{
+  Json::Value my_invalid;
+  if (!invalid) invalid = &my_invalid;  // so we do not need to test for NULL
+  Json::Value& inv = *invalid;
+  std::set<JSONCPP_STRING> valid_keys;
+  getValidCborWriterKeys(&valid_keys);
+  Value::Members keys = settings_.getMemberNames();
+  size_t n = keys.size();
+  for (size_t i = 0; i < n; ++i) {
+    JSONCPP_STRING const& key = keys[i];
+    if (valid_keys.find(key) == valid_keys.end()) {
+      inv[key] = settings_[key];
+    }
+  }
+  return 0u == inv.size();
+}
+Value& CborStreamWriterBuilder::operator[](JSONCPP_STRING key)
+{
+  return settings_[key];
+}
+// static
+void CborStreamWriterBuilder::setDefaults(Json::Value* settings)
+{
+  (*settings)["shortestFloat"] = true;
+}
+
 JSONCPP_STRING writeString(StreamWriter::Factory const& builder, Value const& root) {
   JSONCPP_OSTRINGSTREAM sout;
   StreamWriterPtr const writer(builder.newStreamWriter());
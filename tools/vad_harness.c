@@ -0,0 +1,406 @@
+//
+//  vad_harness.c
+//  witpp
+//
+//  Runs labelled WAV files through the voice activity detector and reports
+//  frame accuracy, endpoint latency and throughput.
+//
+//  build: cc -std=c99 -O2 -Iinclude tools/vad_harness.c vad.c -lm -o vad_harness
+//
+//  usage: vad_harness [options] file.wav...
+//   every file.wav needs a file.txt next to it with one speech segment per line,
+//   "start end" in seconds (the label export of Audacity works as it is).
+//   16 bits pcm wav only; the first channel is used.
+//
+
+#include "vad.h"
+#include <time.h>
+
+/* labelled speech segments of a file, in seconds */
+typedef struct {
+    double *start;
+    double *end;
+    int count;
+} segments;
+
+/* totals over the whole corpus */
+typedef struct {
+    long frames;
+    long correct;
+    /* frames labelled silent, and those of them where the detector was talking */
+    long silent;
+    long false_alarms;
+    long false_stops;
+    long false_starts;
+    long endpoints;
+    long missed_endpoints;
+    double latency_sum;
+    double latency_max;
+    double seconds;
+} report;
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: vad_harness [options] file.wav...\n"
+            "  -t dB      energy threshold\n"
+            "  -i frames  noise floor learning frames\n"
+            "  -f ms      frame length\n"
+            "  -o frames  onset window (speech frames to start talking)\n"
+            "  -O frames  offset window (non-speech frames to stop talking)\n"
+            "  -a frames  noise floor adaptation frames\n"
+            "  -m mode    power (default) or dbfs\n"
+            "  -e engine  energy (default) or spectral\n"
+            "  -s ratio   spectral engine threshold\n"
+            "every file.wav needs a file.txt with one \"start end\" speech segment (seconds) per line\n");
+}
+
+static uint32_t read_le32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t read_le16(const unsigned char *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+/**
+ * load_wav - reads the first channel of a 16 bits pcm wav file
+ *  @path: the file
+ *  @nb_samples: receives the number of samples
+ *  @sample_rate: receives the sample rate
+ *
+ *  Return a new allocated buffer of samples, which will need to be freed later, or NULL
+ */
+static int16_t *load_wav(const char *path, int *nb_samples, int *sample_rate)
+{
+    FILE *file;
+    unsigned char *data = NULL;
+    int16_t *samples = NULL;
+    long size;
+    long pos;
+    int channels = 0;
+    int bits = 0;
+    int format = 0;
+    
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) >= 12 && fseek(file, 0, SEEK_SET) == 0) {
+        data = malloc(size);
+        if (data != NULL && fread(data, 1, size, file) != (size_t)size) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(file);
+    if (data == NULL || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0) {
+        free(data);
+        return NULL;
+    }
+    for (pos = 12; pos + 8 <= size; ) {
+        uint32_t chunk = read_le32(data + pos + 4);
+        const unsigned char *body = data + pos + 8;
+    
+        if (chunk > (uint32_t)(size - pos - 8)) {
+            chunk = (uint32_t)(size - pos - 8);
+        }
+        if (memcmp(data + pos, "fmt ", 4) == 0 && chunk >= 16) {
+            format = read_le16(body);
+            channels = read_le16(body + 2);
+            *sample_rate = (int)read_le32(body + 4);
+            bits = read_le16(body + 14);
+        }
+        else if (memcmp(data + pos, "data", 4) == 0 && channels > 0) {
+            int i;
+    
+            if ((format != 1 && format != 0xFFFE) || bits != 16) {
+                break;
+            }
+            *nb_samples = (int)(chunk / (2 * channels));
+            samples = malloc(sizeof(*samples) * (*nb_samples > 0 ? *nb_samples : 1));
+            if (samples != NULL) {
+                for (i = 0; i < *nb_samples; i++) {
+                    samples[i] = (int16_t)read_le16(body + (size_t)i * 2 * channels);
+                }
+            }
+            break;
+        }
+        pos += 8 + chunk + (chunk & 1);
+    }
+    free(data);
+    
+    return samples;
+}
+
+/**
+ * load_labels - reads the speech segments labelled for a wav file
+ *  @wav_path: the wav file; its extension is replaced by .txt
+ *  @labels: receives the segments
+ *
+ *  Return 0 on success
+ */
+static int load_labels(const char *wav_path, segments *labels)
+{
+    char path[4096];
+    const char *dot = strrchr(wav_path, '.');
+    size_t length = dot ? (size_t)(dot - wav_path) : strlen(wav_path);
+    FILE *file;
+    double start, end;
+    int capacity = 0;
+    
+    if (length + 5 > sizeof(path)) {
+        return -1;
+    }
+    memcpy(path, wav_path, length);
+    strcpy(path + length, ".txt");
+    file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    labels->start = labels->end = NULL;
+    labels->count = 0;
+    while (fscanf(file, "%lf %lf%*[^\n]", &start, &end) == 2) {
+        if (labels->count == capacity) {
+            double *grown;
+            
+            capacity = capacity ? capacity * 2 : 16;
+            /* the old blocks stay in labels until both grew, so a failure frees them */
+            grown = realloc(labels->start, sizeof(double) * capacity);
+            if (grown != NULL) {
+                labels->start = grown;
+                grown = realloc(labels->end, sizeof(double) * capacity);
+            }
+            if (grown == NULL) {
+                free(labels->start);
+                free(labels->end);
+                labels->start = labels->end = NULL;
+                labels->count = 0;
+                fclose(file);
+                return -1;
+            }
+            labels->end = grown;
+        }
+        labels->start[labels->count] = start;
+        labels->end[labels->count] = end;
+        labels->count++;
+    }
+    fclose(file);
+    
+    return 0;
+}
+
+static int is_speech(const segments *labels, double time)
+{
+    int i;
+    
+    for (i = 0; i < labels->count; i++) {
+        if (time >= labels->start[i] && time < labels->end[i]) {
+            return 1;
+        }
+    }
+    
+    return 0;
+}
+
+/**
+ * run_file - runs one file through a fresh detector and adds its results to the report
+ *  Return 0 on success
+ */
+static int run_file(const char *path, const wvs_params *params, report *total)
+{
+    segments labels;
+    wvs_state *state;
+    int16_t *samples;
+    char *decisions;
+    int nb_samples = 0;
+    int sample_rate = 0;
+    int nb_frames;
+    int frame_size;
+    int frame;
+    int i;
+    long correct = 0;
+    long silent = 0;
+    long false_alarms = 0;
+    long false_stops = 0;
+    long false_starts = 0;
+    clock_t begin;
+    double seconds;
+    double frame_seconds;
+    
+    samples = load_wav(path, &nb_samples, &sample_rate);
+    if (samples == NULL) {
+        fprintf(stderr, "%s: not a 16 bits pcm wav file\n", path);
+        return -1;
+    }
+    if (load_labels(path, &labels) != 0) {
+        fprintf(stderr, "%s: no labels\n", path);
+        free(samples);
+        return -1;
+    }
+    state = wvs_init_params(params, sample_rate);
+    if (state == NULL) {
+        fprintf(stderr, "%s: invalid parameters for %d Hz\n", path, sample_rate);
+        free(samples);
+        free(labels.start);
+        free(labels.end);
+        return -1;
+    }
+    frame_size = state->samples_per_frame;
+    frame_seconds = (double)frame_size / sample_rate;
+    nb_frames = nb_samples / frame_size;
+    decisions = malloc(nb_frames > 0 ? nb_frames : 1);
+    if (decisions == NULL) {
+        fprintf(stderr, "%s: out of memory\n", path);
+        wvs_clean(state);
+        free(samples);
+        free(labels.start);
+        free(labels.end);
+        return -1;
+    }
+    
+    begin = clock();
+    for (frame = 0; frame < nb_frames; frame++) {
+        wvs_still_talking(state, samples + (size_t)frame * frame_size, frame_size);
+        decisions[frame] = (char)state->talking;
+    }
+    seconds = (double)(clock() - begin) / CLOCKS_PER_SEC;
+    
+    for (frame = 0; frame < nb_frames; frame++) {
+        int speech = is_speech(&labels, (frame + 0.5) * frame_seconds);
+    
+        correct += (decisions[frame] == speech);
+        silent += !speech;
+        false_alarms += !speech && decisions[frame];
+        if (frame > 0 && decisions[frame - 1] && !decisions[frame] && speech) {
+            false_stops++;
+        }
+        /* a start with no speech during its onset window */
+        if (frame > 0 && !decisions[frame - 1] && decisions[frame] &&
+            !is_speech(&labels, (frame + 0.5) * frame_seconds) &&
+            !is_speech(&labels, (frame + 0.5 - state->talk_frames) * frame_seconds)) {
+            false_starts++;
+        }
+    }
+    /* endpoint latency: from the end of a segment to the first stop before the next segment */
+    for (i = 0; i < labels.count; i++) {
+        double limit = (i + 1 < labels.count) ? labels.start[i + 1] : nb_frames * frame_seconds;
+        double latency = -1;
+    
+        for (frame = (int)(labels.end[i] / frame_seconds); frame > 0 && frame < nb_frames; frame++) {
+            if ((frame + 1) * frame_seconds > limit) {
+                break;
+            }
+            if (decisions[frame - 1] && !decisions[frame]) {
+                latency = (frame + 1) * frame_seconds - labels.end[i];
+                break;
+            }
+        }
+        total->endpoints++;
+        if (latency < 0) {
+            total->missed_endpoints++;
+            continue;
+        }
+        total->latency_sum += latency;
+        if (latency > total->latency_max) {
+            total->latency_max = latency;
+        }
+    }
+    printf("%s: %d frames, accuracy %.2f%%, false alarms %.2f%%, %ld false starts, %ld false stops\n", path, nb_frames,
+           nb_frames ? 100.0 * correct / nb_frames : 0.0, silent ? 100.0 * false_alarms / silent : 0.0,
+           false_starts, false_stops);
+    total->frames += nb_frames;
+    total->correct += correct;
+    total->silent += silent;
+    total->false_alarms += false_alarms;
+    total->false_stops += false_stops;
+    total->false_starts += false_starts;
+    total->seconds += seconds;
+    
+    wvs_clean(state);
+    free(decisions);
+    free(samples);
+    free(labels.start);
+    free(labels.end);
+    
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    wvs_params params;
+    report total;
+    int failures = 0;
+    int i;
+    
+    wvs_default_params(&params);
+    memset(&total, 0, sizeof(total));
+    for (i = 1; i < argc && argv[i][0] == '-'; i += 2) {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+    
+        if (value == NULL || argv[i][1] == 0 || argv[i][2] != 0) {
+            usage();
+            return 2;
+        }
+        switch (argv[i][1]) {
+            case 't': params.energy_threshold = atof(value); break;
+            case 'i': params.init_frames = atoi(value); break;
+            case 'f': params.frame_ms = atoi(value); break;
+            case 'o': params.onset_frames = atoi(value); break;
+            case 'O': params.offset_frames = atoi(value); break;
+            case 'a': params.adaptation_frames = atoi(value); break;
+            case 'm':
+                if (strcmp(value, "power") == 0) {
+                    params.energy_mode = WVS_ENERGY_POWER;
+                }
+                else if (strcmp(value, "dbfs") == 0) {
+                    params.energy_mode = WVS_ENERGY_DBFS_MEAN;
+                }
+                else {
+                    usage();
+                    return 2;
+                }
+                break;
+            case 'e':
+                if (strcmp(value, "energy") == 0) {
+                    params.engine = WVS_ENGINE_ENERGY;
+                }
+                else if (strcmp(value, "spectral") == 0) {
+                    params.engine = WVS_ENGINE_SPECTRAL;
+                }
+                else {
+                    usage();
+                    return 2;
+                }
+                break;
+            case 's': params.spectral_threshold = atof(value); break;
+            default:
+                usage();
+                return 2;
+        }
+    }
+    if (i == argc) {
+        usage();
+        return 2;
+    }
+    for (; i < argc; i++) {
+        if (run_file(argv[i], &params, &total) != 0) {
+            failures++;
+        }
+    }
+    
+    printf("total: %ld frames, accuracy %.2f%%, false alarms %.2f%%, %ld false starts, %ld false stops\n", total.frames,
+           total.frames ? 100.0 * total.correct / total.frames : 0.0,
+           total.silent ? 100.0 * total.false_alarms / total.silent : 0.0, total.false_starts, total.false_stops);
+    printf("endpoints: %ld, missed %ld, latency mean %.0f ms, max %.0f ms\n", total.endpoints,
+           total.missed_endpoints,
+           total.endpoints > total.missed_endpoints ? 1000.0 * total.latency_sum / (total.endpoints - total.missed_endpoints) : 0.0,
+           1000.0 * total.latency_max);
+    if (total.seconds > 0) {
+        printf("throughput: %.0f frames per second\n", total.frames / total.seconds);
+    }
+    
+    return failures ? 1 : 0;
+}
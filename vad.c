@@ -8,60 +8,355 @@
 
 #include "vad.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define WVS_AVX2 1
+#define WVS_SSE2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WVS_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define WVS_NEON 1
+#endif
+
+/**
+ * wvs_sample_dbfs - converts a short (16 bits) sample to decibel full scale
+ *  @sample: a non-zero pcm 16 bits sample
+ */
+static inline wvs_energy wvs_sample_dbfs(int16_t sample);
+
 /**
- * wvs_pcm16short2dbfs - converts short (16 bits) samples to decibel full scale
+ * wvs_sum_squares - sum of the squares of pcm 16 bits samples
  *  @samples: array of pcm 16 bits samples
  *  @size: numbers of sample
  *
- *  Return a new allocated buffer of double, which will need to be freed later
+ *  The sum is exact, so every kernel (AVX2, SSE2, NEON or scalar) gives the same decisions.
+ */
+static uint64_t wvs_sum_squares(const int16_t *samples, int size);
+
+/**
+ * wvs_sum_squares_interleaved - per channel sum of the squares of interleaved samples
+ *  @samples: pcm 16 bits samples, samples[i * nb_channels + channel]
+ *  @nb_samples: numbers of sample per channel
+ *  @nb_channels: numbers of channel
+ *  @sums: receives the nb_channels sums
+ */
+static void wvs_sum_squares_interleaved(const int16_t *samples, int nb_samples, int nb_channels, uint64_t *sums);
+
+/**
+ * wvs_power_energy - attenuation of a frame, in dB, from its sum of squared samples
+ *  @sum: sum of the squared samples
+ *  @nb_samples: numbers of sample of the frame
+ */
+static wvs_energy wvs_power_energy(uint64_t sum, int nb_samples);
+
+/**
+ * wvs_running_average - the noise floor update
+ *  @average: the current noise floor
+ *  @energy: the energy of the new frame
+ *  @n: weight of the current noise floor
  */
-static double * wvs_pcm16short2dbfs(int16_t *samples, int size);
+static inline wvs_energy wvs_running_average(wvs_energy average, wvs_energy energy, int n);
 
-static double frames_detector_esf_energy(double *samples, int nb_samples);
-static void detector_esf_minimum(wvs_state *state, double energy, int n);
-static int detector_esf_check_frame(wvs_state *state, double energy);
-static void memory_push(int *memory, int length, int value);
-static int frame_memory_lte(int *memory, int value, int nb);
-static int frame_memory_gte(int *memory, int value, int nb);
-static int wvs_check(wvs_state *state, double *samples, int nb_samples);
+#ifdef WVS_FIXED_POINT
+/**
+ * wvs_log2_q16 - base 2 logarithm in Q16 fixed point
+ *  @x: a number greater than 0
+ */
+static int32_t wvs_log2_q16(uint64_t x);
+#endif
+
+/* where the decisions taken on a chunk go */
+typedef struct {
+    /* return as soon as the speaker stops talking (wvs_still_talking) */
+    int stop_on_end;
+    
+    wvs_event *events;
+    
+    int max_events;
+    
+    /* events that happened, even those that did not fit in events */
+    int nb_events;
+} wvs_sink;
+
+static int wvs_still_talking_power(wvs_state *state, const int16_t *samples, int nb_samples, wvs_sink *sink);
+static int wvs_still_talking_dbfs(wvs_state *state, const int16_t *samples, int nb_samples, wvs_sink *sink);
+static int wvs_record(wvs_state *state, wvs_sink *sink, int action, int64_t frame_end);
+static int wvs_feed(wvs_state *state, const int16_t *samples, int nb_samples, wvs_sink *sink);
+static int wvs_still_talking_spectral(wvs_state *state, const int16_t *samples, int nb_samples, wvs_sink *sink);
+static wvs_spectral *wvs_spectral_init(const wvs_params *params, int sample_rate, int samples_per_frame);
+static int wvs_spectral_frame(wvs_state *state);
+static void wvs_spectral_clean(wvs_spectral *spectral);
+static int wvs_fill_frame(wvs_state *state, const int16_t *samples, int nb_samples);
+static void detector_esf_minimum(wvs_state *state, wvs_energy energy, int n);
+static int detector_esf_check_frame(wvs_state *state, wvs_energy energy);
+static void memory_push(wvs_state *state, int value);
+static int wvs_check(wvs_state *state, wvs_energy energy);
+static int wvs_decide(wvs_state *state, int counter);
+static int wvs_params_frame_size(const wvs_params *params, int sample_rate);
 
 
-int wvs_still_talking(wvs_state *state, int16_t *samples, int nb_samples)
+int wvs_still_talking(wvs_state *state, const int16_t *samples, int nb_samples)
 {
-    double *dbfss;
-    double db;
-    int result;
+    wvs_sink sink = { 1, NULL, 0, 0 };
     
-    dbfss = wvs_pcm16short2dbfs(samples, nb_samples);
-    for (int i_sample = 0; i_sample < nb_samples; i_sample++) {
-        db = dbfss[i_sample];
-        if (isinf(db)) {
-            continue;
+    return wvs_feed(state, samples, nb_samples, &sink);
+}
+
+int wvs_process(wvs_state *state, const int16_t *samples, int nb_samples, wvs_event *events, int max_events)
+{
+    wvs_sink sink = { 0, events, max_events, 0 };
+    
+    wvs_feed(state, samples, nb_samples, &sink);
+    
+    return sink.nb_events;
+}
+
+/**
+ * wvs_feed - runs a chunk through the engine of the detector
+ *  Return 0 when the sink stopped the processing, 1 otherwise.
+ */
+static int wvs_feed(wvs_state *state, const int16_t *samples, int nb_samples, wvs_sink *sink)
+{
+    if (state->engine == WVS_ENGINE_SPECTRAL) {
+        return wvs_still_talking_spectral(state, samples, nb_samples, sink);
+    }
+    if (state->energy_mode == WVS_ENERGY_DBFS_MEAN) {
+        return wvs_still_talking_dbfs(state, samples, nb_samples, sink);
+    }
+    return wvs_still_talking_power(state, samples, nb_samples, sink);
+}
+
+/**
+ * wvs_record - hands the decision taken on a frame to the sink
+ *  @state: the detector state
+ *  @sink: where the decisions go
+ *  @action: what wvs_check returned
+ *  @frame_end: stream offset of the end of the frame
+ *
+ *  Return 0 when the caller must stop processing the chunk, 1 otherwise.
+ */
+static int wvs_record(wvs_state *state, wvs_sink *sink, int action, int64_t frame_end)
+{
+    wvs_event *event;
+    int64_t offset;
+    
+    if (action < 0) {
+        return 1;
+    }
+    if (sink->stop_on_end) {
+        return action != 0;
+    }
+    /* speech started with the first frame of the onset window and ended with the last speech frame before the offset window */
+    offset = frame_end - (int64_t)state->samples_per_frame * (action == 1 ? state->talk_frames : state->stop_frames);
+    if (sink->nb_events < sink->max_events) {
+        event = &sink->events[sink->nb_events];
+        event->type = (action == 1) ? WVS_SPEECH_START : WVS_SPEECH_END;
+        event->offset = (offset > 0) ? offset : 0;
+    }
+    sink->nb_events++;
+    
+    return 1;
+}
+
+static int wvs_still_talking_power(wvs_state *state, const int16_t *samples, int nb_samples, wvs_sink *sink)
+{
+    const int64_t base = state->stream_offset;
+    int i_sample = 0;
+    int count;
+    wvs_energy energy;
+    
+    state->stream_offset += nb_samples;
+    
+    while (i_sample < nb_samples) {
+        count = state->samples_per_frame - state->current_nb_samples;
+        if (count > nb_samples - i_sample) {
+            count = nb_samples - i_sample;
         }
-        if (state->current_nb_samples == state->samples_per_frame) {
-            result = wvs_check(state, state->samples, state->current_nb_samples);
-            if (result == 0) {
-                free(dbfss);
-                return 0;
-            }
-            state->current_nb_samples = 0;
+        state->frame_power += wvs_sum_squares(samples + i_sample, count);
+        state->current_nb_samples += count;
+        i_sample += count;
+        if (state->current_nb_samples < state->samples_per_frame) {
+            break;
+        }
+        energy = wvs_power_energy(state->frame_power, state->current_nb_samples);
+        state->frame_power = 0;
+        state->current_nb_samples = 0;
+        if (wvs_record(state, sink, wvs_check(state, energy), base + i_sample) == 0) {
+            return 0;
         }
-        state->samples[state->current_nb_samples] = db;
-        state->current_nb_samples++;
     }
-    free(dbfss);
     
     return 1;
 }
 
-static int wvs_check(wvs_state *state, double *samples, int nb_samples)
+#ifdef WVS_FIXED_POINT
+
+/* log2(1 + i / 256) in Q16 */
+static const uint32_t wvs_log2_table[257] = {
+    0, 369, 736, 1102, 1466, 1829, 2190, 2551,
+    2909, 3267, 3623, 3978, 4331, 4683, 5034, 5384,
+    5732, 6079, 6425, 6769, 7112, 7454, 7795, 8134,
+    8473, 8810, 9146, 9480, 9814, 10146, 10477, 10807,
+    11136, 11464, 11791, 12116, 12440, 12764, 13086, 13407,
+    13727, 14046, 14363, 14680, 14996, 15310, 15624, 15937,
+    16248, 16559, 16868, 17177, 17484, 17791, 18096, 18401,
+    18704, 19007, 19308, 19609, 19909, 20207, 20505, 20802,
+    21098, 21393, 21687, 21980, 22272, 22564, 22854, 23144,
+    23433, 23720, 24007, 24293, 24579, 24863, 25146, 25429,
+    25711, 25992, 26272, 26551, 26830, 27108, 27384, 27660,
+    27936, 28210, 28484, 28757, 29029, 29300, 29571, 29840,
+    30109, 30378, 30645, 30912, 31178, 31443, 31707, 31971,
+    32234, 32496, 32758, 33019, 33279, 33538, 33797, 34055,
+    34312, 34569, 34825, 35080, 35334, 35588, 35841, 36094,
+    36346, 36597, 36847, 37097, 37346, 37595, 37842, 38090,
+    38336, 38582, 38827, 39072, 39316, 39559, 39802, 40044,
+    40286, 40527, 40767, 41006, 41246, 41484, 41722, 41959,
+    42196, 42432, 42667, 42902, 43137, 43370, 43603, 43836,
+    44068, 44300, 44530, 44761, 44990, 45220, 45448, 45676,
+    45904, 46131, 46357, 46583, 46809, 47034, 47258, 47482,
+    47705, 47928, 48150, 48372, 48593, 48813, 49034, 49253,
+    49472, 49691, 49909, 50127, 50344, 50560, 50776, 50992,
+    51207, 51422, 51636, 51850, 52063, 52276, 52488, 52700,
+    52911, 53122, 53332, 53542, 53751, 53960, 54169, 54377,
+    54584, 54791, 54998, 55204, 55410, 55615, 55820, 56025,
+    56229, 56432, 56635, 56838, 57040, 57242, 57443, 57644,
+    57845, 58045, 58245, 58444, 58643, 58841, 59039, 59237,
+    59434, 59631, 59827, 60023, 60219, 60414, 60609, 60803,
+    60997, 61190, 61384, 61576, 61769, 61961, 62152, 62343,
+    62534, 62725, 62915, 63104, 63294, 63483, 63671, 63859,
+    64047, 64234, 64421, 64608, 64794, 64980, 65166, 65351,
+    65536
+};
+
+static int32_t wvs_log2_q16(uint64_t x)
+{
+    int32_t msb = 0;
+    uint32_t mantissa;
+    uint32_t index;
+    uint32_t fraction;
+    
+    if (x >> 32) { msb += 32; }
+    if (x >> (msb + 16)) { msb += 16; }
+    if (x >> (msb + 8)) { msb += 8; }
+    if (x >> (msb + 4)) { msb += 4; }
+    if (x >> (msb + 2)) { msb += 2; }
+    if (x >> (msb + 1)) { msb += 1; }
+    /* the 16 bits below the leading one, interpolated in the table */
+    mantissa = (uint32_t)((msb >= 16 ? x >> (msb - 16) : x << (16 - msb)) & 0xFFFF);
+    index = mantissa >> 8;
+    fraction = mantissa & 0xFF;
+    
+    return (msb << 16) + (int32_t)(wvs_log2_table[index] + (((wvs_log2_table[index + 1] - wvs_log2_table[index]) * fraction) >> 8));
+}
+
+static wvs_energy wvs_power_energy(uint64_t sum, int nb_samples)
 {
-    int counter;
-    double energy;
+    /* 10 * log10(2) in Q16: dB per octave of power */
+    const int64_t db_per_octave = 197283;
+    uint64_t power;
+    
+    power = sum / (uint64_t)nb_samples;
+    /* digital silence is floored at the power of one LSB */
+    if (power < 1) {
+        power = 1;
+    }
+    /* 10 * log10(2^30 / power), from Q32 down to Q8 */
+    return (wvs_energy)(((((int64_t)30 << 16) - wvs_log2_q16(power)) * db_per_octave + ((int64_t)1 << 23)) >> 24);
+}
+
+static inline wvs_energy wvs_running_average(wvs_energy average, wvs_energy energy, int n)
+{
+    return (wvs_energy)(((int64_t)average * n + energy) / (n + 1));
+}
+
+#else
+
+static wvs_energy wvs_power_energy(uint64_t sum, int nb_samples)
+{
+    /* mean power of a frame of full scale samples */
+    const double full_scale = 32768.0 * 32768.0;
+    double power;
+    
+    power = (double)sum / nb_samples;
+    /* digital silence is floored at the power of one LSB */
+    if (power < 1.0) {
+        power = 1.0;
+    }
+    
+    return 0 - 10 * log10(power / full_scale);
+}
+
+static inline wvs_energy wvs_running_average(wvs_energy average, wvs_energy energy, int n)
+{
+    return (average * n + energy) / (n + 1);
+}
+
+#endif
+
+static int wvs_still_talking_dbfs(wvs_state *state, const int16_t *samples, int nb_samples, wvs_sink *sink)
+{
+    const int64_t base = state->stream_offset;
+    int i_sample = 0;
     int action;
     
-    action = -1;
-    energy = frames_detector_esf_energy(samples, nb_samples);
+    state->stream_offset += nb_samples;
+
+    while (i_sample < nb_samples) {
+        i_sample += wvs_fill_frame(state, samples + i_sample, nb_samples - i_sample);
+        if (state->current_nb_samples < state->samples_per_frame) {
+            break;
+        }
+        /* a full frame is checked when the next audible sample comes in */
+        while (i_sample < nb_samples && samples[i_sample] == 0) {
+            i_sample++;
+        }
+        if (i_sample == nb_samples) {
+            break;
+        }
+        action = wvs_check(state, (wvs_energy)(state->frame_energy / state->current_nb_samples));
+        if (wvs_record(state, sink, action, base + i_sample) == 0) {
+            return 0;
+        }
+        state->frame_energy = 0;
+        state->current_nb_samples = 0;
+    }
+    
+    return 1;
+}
+
+/**
+ * wvs_fill_frame - accumulates samples into the current frame until it is full
+ *  @state: the detector state
+ *  @samples: pcm 16 bits samples
+ *  @nb_samples: numbers of sample
+ *
+ *  Silent (zero) samples are -inf DBFS and are skipped.
+ *  Return the number of samples consumed.
+ */
+static int wvs_fill_frame(wvs_state *state, const int16_t *samples, int nb_samples)
+{
+    wvs_energy_sum energy = state->frame_energy;
+    int count = state->current_nb_samples;
+    int i;
+    
+    for (i = 0; i < nb_samples && count < state->samples_per_frame; i++) {
+        if (samples[i] == 0) {
+            continue;
+        }
+        energy += wvs_sample_dbfs(samples[i]);
+        count++;
+    }
+    state->frame_energy = energy;
+    state->current_nb_samples = count;
+    
+    return i;
+}
+
+static int wvs_check(wvs_state *state, wvs_energy energy)
+{
+    int counter;
     
     if (state->sequence <= state->init_frames) {
         detector_esf_minimum(state, energy, state->sequence);
@@ -70,16 +365,32 @@ static int wvs_check(wvs_state *state, double *samples, int nb_samples)
     if (state->sequence >= state->init_frames && !counter && !state->talking) {
         detector_esf_minimum(state, energy, state->sequence);
     }
-    memory_push(state->previous_state, state->previous_state_maxlen, counter);
+    
+    return wvs_decide(state, counter);
+}
+
+/**
+ * wvs_decide - applies the onset and offset windows to the decision taken on a frame
+ *  @state: the detector state
+ *  @counter: 1 if the frame is speech, 0 otherwise
+ *
+ *  Return 1 when the speaker starts talking, 0 when they stop, -1 otherwise.
+ */
+static int wvs_decide(wvs_state *state, int counter)
+{
+    int action;
+    
+    action = -1;
+    memory_push(state, counter);
     if (state->sequence < state->init_frames) {
         state->sequence++;
         return -1;
     }
-    if (state->talking == 0 && frame_memory_gte(state->previous_state, 1, 10)) {
+    if (state->talking == 0 && state->speech_frames_short == state->talk_frames) {
         state->talking = 1;
             action = 1;
         }
-        else if (state->talking == 1 && frame_memory_lte(state->previous_state, 0, state->previous_state_maxlen)) {
+        else if (state->talking == 1 && state->speech_frames_long == 0) {
             state->talking = 0;
             action = 0;
         }
@@ -90,110 +401,869 @@ static int wvs_check(wvs_state *state, double *samples, int nb_samples)
 
 
 wvs_state *wvs_init(double threshold, int sample_rate)
+{
+    wvs_params params;
+    
+    wvs_default_params(&params);
+    /* the detectors made before wvs_params keep their decisions and the scale of their threshold */
+    params.energy_mode = WVS_ENERGY_DBFS_MEAN;
+    if (threshold > 0) {
+        params.energy_threshold = threshold;
+    }
+    
+    return wvs_init_params(&params, sample_rate);
+}
+
+void wvs_default_params(wvs_params *params)
+{
+    params->energy_threshold = 8.0;
+    params->init_frames = 30;
+    params->frame_ms = 10;
+    params->onset_frames = 10;
+    params->offset_frames = 30;
+    params->adaptation_frames = 10;
+    params->energy_mode = WVS_ENERGY_POWER;
+    params->engine = WVS_ENGINE_ENERGY;
+    params->spectral_threshold = 2.5;
+}
+
+/**
+ * wvs_params_frame_size - checks the parameters and computes the frame size
+ *  @params: the tuning
+ *  @sample_rate: number of sample per second
+ *
+ *  Return the number of samples of a frame (at least 1), or 0 when a parameter is out of range.
+ */
+static int wvs_params_frame_size(const wvs_params *params, int sample_rate)
+{
+    int samples_per_frame;
+    
+    if (params->init_frames < 0 || params->frame_ms < 1 || params->onset_frames < 1 ||
+        params->offset_frames < 1 || params->adaptation_frames < 0 || sample_rate < 1) {
+        return 0;
+    }
+    samples_per_frame = (int)((int64_t)sample_rate * params->frame_ms / 1000);
+    
+    return (samples_per_frame < 1) ? 1 : samples_per_frame;
+}
+
+wvs_state *wvs_init_params(const wvs_params *params, int sample_rate)
 {
     wvs_state *state;
+    int samples_per_frame;
     
+    samples_per_frame = wvs_params_frame_size(params, sample_rate);
+    if (samples_per_frame == 0) {
+        return NULL;
+    }
     state = malloc(sizeof(*state));
+    if (state == NULL) {
+        return NULL;
+    }
     state->sequence = 0;
     state->min_initialized = 0;
-    state->init_frames = 30;
-    state->energy_threshold = 8.0;
-    state->previous_state_maxlen = 30;
-    state->previous_state = malloc(sizeof(*state->previous_state) * state->previous_state_maxlen);
+    state->init_frames = params->init_frames;
+    state->energy_threshold = (wvs_energy)(params->energy_threshold * WVS_ENERGY_SCALE);
+    state->talk_frames = params->onset_frames;
+    state->stop_frames = params->offset_frames;
+    state->adaptation_frames = params->adaptation_frames;
+    state->previous_state_maxlen = (state->talk_frames > state->stop_frames) ? state->talk_frames : state->stop_frames;
+    state->previous_state = calloc(state->previous_state_maxlen, sizeof(*state->previous_state));
+    if (state->previous_state == NULL) {
+        free(state);
+        return NULL;
+    }
+    state->previous_state_head = 0;
+    state->speech_frames_short = 0;
+    state->speech_frames_long = 0;
     state->talking = 0;
     state->sample_rate = sample_rate;
-    state->samples_per_frame = state->sample_rate / 100;
-    state->samples = malloc(sizeof(*state->samples) * state->samples_per_frame);
+    state->samples_per_frame = samples_per_frame;
+    state->energy_mode = params->energy_mode;
+    state->stream_offset = 0;
+    state->engine = params->engine;
+    state->spectral = NULL;
+    if (state->engine == WVS_ENGINE_SPECTRAL) {
+        state->spectral = wvs_spectral_init(params, sample_rate, samples_per_frame);
+        if (state->spectral == NULL) {
+            free(state->previous_state);
+            free(state);
+            return NULL;
+        }
+    }
+    state->frame_energy = 0;
+    state->frame_power = 0;
     state->current_nb_samples = 0;
-    state->min_energy = 0.0;
+    state->min_energy = 0;
     
     return state;
 }
 
+void wvs_set_energy_mode(wvs_state *state, wvs_energy_mode mode)
+{
+    state->energy_mode = mode;
+    state->frame_energy = 0;
+    state->frame_power = 0;
+    state->current_nb_samples = 0;
+}
+
 void wvs_clean(wvs_state *state)
 {
-    free(state->samples);
+    if (state->spectral != NULL) {
+        wvs_spectral_clean(state->spectral);
+    }
     free(state->previous_state);
     free(state);
 }
 
-static double * wvs_pcm16short2dbfs(int16_t *samples, int size)
+wvs_batch *wvs_batch_init(int nb_channels, double threshold, int sample_rate)
 {
-    double *dbfss;
-    double max_ref;
+    wvs_params params;
     
-    max_ref = 32768; //pow(2.0, 16.0) / 2; signed 16 bits w/o the -1
-    dbfss = malloc(sizeof(*dbfss) * size);
+    wvs_default_params(&params);
+    if (threshold > 0) {
+        params.energy_threshold = threshold;
+    }
     
-    for (int i = 0; i < size; i++) {
-        dbfss[i] = 0 - 20 * log10(fabs(samples[i] / max_ref));
+    return wvs_batch_init_params(nb_channels, &params, sample_rate);
+}
+
+wvs_batch *wvs_batch_init_params(int nb_channels, const wvs_params *params, int sample_rate)
+{
+    wvs_batch *batch;
+    int samples_per_frame;
+    int n;
+    
+    samples_per_frame = wvs_params_frame_size(params, sample_rate);
+    if (nb_channels < 1 || samples_per_frame == 0 || params->engine != WVS_ENGINE_ENERGY) {
+        return NULL;
+    }
+    batch = calloc(1, sizeof(*batch));
+    if (batch == NULL) {
+        return NULL;
+    }
+    n = nb_channels;
+    batch->nb_channels = n;
+    batch->init_frames = params->init_frames;
+    batch->energy_threshold = (wvs_energy)(params->energy_threshold * WVS_ENERGY_SCALE);
+    batch->talk_frames = params->onset_frames;
+    batch->stop_frames = params->offset_frames;
+    batch->adaptation_frames = params->adaptation_frames;
+    batch->previous_state_maxlen = (batch->talk_frames > batch->stop_frames) ? batch->talk_frames : batch->stop_frames;
+    batch->samples_per_frame = samples_per_frame;
+    batch->sequence = calloc(n, sizeof(*batch->sequence));
+    batch->min_energy = calloc(n, sizeof(*batch->min_energy));
+    batch->talking = calloc((n + 31) / 32, sizeof(*batch->talking));
+    batch->previous_state = calloc((size_t)n * batch->previous_state_maxlen, sizeof(*batch->previous_state));
+    batch->speech_frames_short = calloc(n, sizeof(*batch->speech_frames_short));
+    batch->speech_frames_long = calloc(n, sizeof(*batch->speech_frames_long));
+    batch->frame_power = calloc(n, sizeof(*batch->frame_power));
+    if (batch->sequence == NULL || batch->min_energy == NULL || batch->talking == NULL ||
+        batch->previous_state == NULL || batch->speech_frames_short == NULL ||
+        batch->speech_frames_long == NULL || batch->frame_power == NULL) {
+        wvs_batch_clean(batch);
+        return NULL;
     }
     
-    return dbfss;
+    return batch;
 }
 
-static double frames_detector_esf_energy(double *samples, int nb_samples)
+int wvs_batch_process(wvs_batch *batch, const int16_t *samples)
+{
+    const int n = batch->nb_channels;
+    const int length = batch->previous_state_maxlen;
+    /* all the channels advance together, so the ring buffer head is shared */
+    const int head = (batch->previous_state_head + 1) % length;
+    uint8_t *newest = batch->previous_state + (size_t)head * n;
+    const uint8_t *leaving_short = batch->previous_state + (size_t)((head - batch->talk_frames + length) % length) * n;
+    const uint8_t *leaving_long = batch->previous_state + (size_t)((head - batch->stop_frames + length) % length) * n;
+    int nb_talking = 0;
+    int channel;
+    
+    wvs_sum_squares_interleaved(samples, batch->samples_per_frame, n, batch->frame_power);
+    for (channel = 0; channel < n; channel++) {
+        wvs_energy energy = wvs_power_energy(batch->frame_power[channel], batch->samples_per_frame);
+        int sequence = batch->sequence[channel];
+        uint32_t bit = (uint32_t)1 << (channel % 32);
+        int talking = (batch->talking[channel / 32] & bit) != 0;
+        int counter;
+        
+        /* same steps as wvs_check, on the arrays of the channel */
+        if (sequence <= batch->init_frames) {
+            int weight = (sequence > batch->adaptation_frames) ? batch->adaptation_frames : sequence;
+            batch->min_energy[channel] = wvs_running_average(batch->min_energy[channel], energy, weight);
+        }
+        counter = (0 - (energy - batch->min_energy[channel])) >= batch->energy_threshold;
+        if (sequence >= batch->init_frames && !counter && !talking) {
+            int weight = (sequence > batch->adaptation_frames) ? batch->adaptation_frames : sequence;
+            batch->min_energy[channel] = wvs_running_average(batch->min_energy[channel], energy, weight);
+        }
+        /* read the decisions leaving both windows before the oldest one is overwritten */
+        batch->speech_frames_short[channel] += counter - leaving_short[channel];
+        batch->speech_frames_long[channel] += counter - leaving_long[channel];
+        newest[channel] = (uint8_t)counter;
+        if (sequence >= batch->init_frames) {
+            if (!talking && batch->speech_frames_short[channel] == batch->talk_frames) {
+                talking = 1;
+            }
+            else if (talking && batch->speech_frames_long[channel] == 0) {
+                talking = 0;
+            }
+        }
+        batch->sequence[channel] = sequence + 1;
+        if (talking) {
+            batch->talking[channel / 32] |= bit;
+            nb_talking++;
+        }
+        else {
+            batch->talking[channel / 32] &= ~bit;
+        }
+    }
+    batch->previous_state_head = head;
+    
+    return nb_talking;
+}
+
+void wvs_batch_reset_channel(wvs_batch *batch, int channel)
 {
-    double energy = 0.0f;
     int i;
     
-    for (i = 0; i < nb_samples; i++) {
-        energy += samples[i];
+    batch->sequence[channel] = 0;
+    batch->min_energy[channel] = 0;
+    batch->talking[channel / 32] &= ~((uint32_t)1 << (channel % 32));
+    batch->speech_frames_short[channel] = 0;
+    batch->speech_frames_long[channel] = 0;
+    for (i = 0; i < batch->previous_state_maxlen; i++) {
+        batch->previous_state[(size_t)i * batch->nb_channels + channel] = 0;
+    }
+}
+
+void wvs_batch_clean(wvs_batch *batch)
+{
+    free(batch->sequence);
+    free(batch->min_energy);
+    free(batch->talking);
+    free(batch->previous_state);
+    free(batch->speech_frames_short);
+    free(batch->speech_frames_long);
+    free(batch->frame_power);
+    free(batch);
+}
+
+/* sub-bands of the spectral engine, in Hz, as in the webrtc detector */
+#define WVS_SPECTRAL_BANDS 6
+static const float wvs_band_edges[WVS_SPECTRAL_BANDS + 1] = { 80, 250, 500, 1000, 2000, 3000, 4000 };
+/* the bands where speech carries the most energy weigh more */
+static const float wvs_band_weights[WVS_SPECTRAL_BANDS] = { 0.6f, 1.0f, 1.2f, 1.2f, 1.0f, 0.8f };
+
+struct wvs_spectral {
+    int fft_size;
+    
+    /* samples of the current frame, windowed when the frame is full */
+    float *frame;
+    
+    /* hann window of samples_per_frame */
+    float *window;
+    
+    /* fft work buffers and tables, fft_size long. the twiddles of the stage of half butterflies
+     are contiguous from half - 1, so the butterfly loop reads them without a stride */
+    float *re;
+    float *im;
+    float *cos_table;
+    float *sin_table;
+    int *bit_reverse;
+    
+    /* fft bins [band_first, band_last) of each band */
+    int band_first[WVS_SPECTRAL_BANDS];
+    int band_last[WVS_SPECTRAL_BANDS];
+    
+    /* log energies of the last frame, in dB */
+    float features[WVS_SPECTRAL_BANDS];
+    
+    /* gaussian models of the log energies, per band */
+    float noise_mean[WVS_SPECTRAL_BANDS];
+    float noise_var[WVS_SPECTRAL_BANDS];
+    float speech_mean[WVS_SPECTRAL_BANDS];
+    float speech_var[WVS_SPECTRAL_BANDS];
+    
+    /* minimum of each log energy, rising slowly: the noise model stays close above it */
+    float floor[WVS_SPECTRAL_BANDS];
+    
+    /* running mean and variance of each log energy, to spot stationary noise */
+    float track_mean[WVS_SPECTRAL_BANDS];
+    float track_var[WVS_SPECTRAL_BANDS];
+    
+    float weight_sum;
+    
+    float threshold;
+};
+
+static wvs_spectral *wvs_spectral_init(const wvs_params *params, int sample_rate, int samples_per_frame)
+{
+    const float pi = 3.14159265358979f;
+    wvs_spectral *spectral;
+    int bits = 0;
+    int half;
+    int band;
+    int i;
+    
+    if (sample_rate < 8000) {
+        return NULL;
+    }
+    spectral = calloc(1, sizeof(*spectral));
+    if (spectral == NULL) {
+        return NULL;
+    }
+    spectral->fft_size = 1;
+    while (spectral->fft_size < samples_per_frame) {
+        spectral->fft_size <<= 1;
+        bits++;
+    }
+    spectral->frame = calloc(samples_per_frame, sizeof(float));
+    spectral->window = malloc(sizeof(float) * samples_per_frame);
+    spectral->re = malloc(sizeof(float) * spectral->fft_size);
+    spectral->im = malloc(sizeof(float) * spectral->fft_size);
+    spectral->cos_table = malloc(sizeof(float) * spectral->fft_size);
+    spectral->sin_table = malloc(sizeof(float) * spectral->fft_size);
+    spectral->bit_reverse = malloc(sizeof(int) * spectral->fft_size);
+    if (spectral->frame == NULL || spectral->window == NULL || spectral->re == NULL || spectral->im == NULL ||
+        spectral->cos_table == NULL || spectral->sin_table == NULL || spectral->bit_reverse == NULL) {
+        wvs_spectral_clean(spectral);
+        return NULL;
+    }
+    for (i = 0; i < samples_per_frame; i++) {
+        spectral->window[i] = 0.5f - 0.5f * cosf(2 * pi * (i + 0.5f) / samples_per_frame);
+    }
+    for (half = 1; half < spectral->fft_size; half <<= 1) {
+        int step = spectral->fft_size / (2 * half);
+        
+        for (i = 0; i < half; i++) {
+            spectral->cos_table[half - 1 + i] = cosf(2 * pi * (i * step) / spectral->fft_size);
+            spectral->sin_table[half - 1 + i] = -sinf(2 * pi * (i * step) / spectral->fft_size);
+        }
+    }
+    for (i = 0; i < spectral->fft_size; i++) {
+        int reversed = 0;
+        int bit;
+        
+        for (bit = 0; bit < bits; bit++) {
+            reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+        }
+        spectral->bit_reverse[i] = reversed;
+    }
+    for (band = 0; band < WVS_SPECTRAL_BANDS; band++) {
+        int first = (int)(wvs_band_edges[band] * spectral->fft_size / sample_rate + 0.5f);
+        int last = (int)(wvs_band_edges[band + 1] * spectral->fft_size / sample_rate + 0.5f);
+        
+        /* short frames have coarse bins: every band gets at least one */
+        if (first < 1) {
+            first = 1;
+        }
+        if (last > spectral->fft_size / 2) {
+            last = spectral->fft_size / 2;
+        }
+        if (last <= first) {
+            last = first + 1;
+        }
+        spectral->band_first[band] = first;
+        spectral->band_last[band] = last;
+        spectral->weight_sum += wvs_band_weights[band];
     }
-    energy /= nb_samples;
+    spectral->threshold = (float)params->spectral_threshold;
     
-    return energy;
+    return spectral;
 }
 
-static void detector_esf_minimum(wvs_state *state, double energy, int n)
+static void wvs_spectral_clean(wvs_spectral *spectral)
 {
-    n = (n > 10) ? 10 : n; //this correspond to 1/10 of a second
-    state->min_energy = (state->min_energy * n + energy) / (n + 1);
-    state->min_initialized = 1;
+    free(spectral->frame);
+    free(spectral->window);
+    free(spectral->re);
+    free(spectral->im);
+    free(spectral->cos_table);
+    free(spectral->sin_table);
+    free(spectral->bit_reverse);
+    free(spectral);
 }
 
-static int detector_esf_check_frame(wvs_state *state, double energy)
+static int wvs_still_talking_spectral(wvs_state *state, const int16_t *samples, int nb_samples, wvs_sink *sink)
 {
-    int counter;
+    const int64_t base = state->stream_offset;
+    float *frame = state->spectral->frame;
+    int i_sample = 0;
+    int count;
+    int i;
     
-    counter = 0;
-    if ((0 - (energy - state->min_energy)) >= state->energy_threshold) {
-        counter++;
+    state->stream_offset += nb_samples;
+    while (i_sample < nb_samples) {
+        count = state->samples_per_frame - state->current_nb_samples;
+        if (count > nb_samples - i_sample) {
+            count = nb_samples - i_sample;
+        }
+        for (i = 0; i < count; i++) {
+            frame[state->current_nb_samples + i] = samples[i_sample + i];
+        }
+        state->current_nb_samples += count;
+        i_sample += count;
+        if (state->current_nb_samples < state->samples_per_frame) {
+            break;
+        }
+        state->current_nb_samples = 0;
+        if (wvs_record(state, sink, wvs_decide(state, wvs_spectral_frame(state)), base + i_sample) == 0) {
+            return 0;
+        }
     }
     
-    return counter;
+    return 1;
+}
+
+/**
+ * wvs_fft_butterflies - the butterflies of one group of an fft stage
+ *  @re_low: real parts of the low halves, updated in place
+ *  @im_low: imaginary parts of the low halves, updated in place
+ *  @re_high: real parts of the high halves, updated in place
+ *  @im_high: imaginary parts of the high halves, updated in place
+ *  @cos_stage: the contiguous twiddles of the stage (real parts)
+ *  @sin_stage: the contiguous twiddles of the stage (imaginary parts)
+ *  @half: number of butterflies
+ *
+ *  Four butterflies at a time with SSE2 or NEON, the rest (and the first stages) one by one.
+ */
+static void wvs_fft_butterflies(float *re_low, float *im_low, float *re_high, float *im_high,
+                                const float *cos_stage, const float *sin_stage, int half)
+{
+    int i = 0;
+    
+#if defined(WVS_SSE2)
+    for (; i + 4 <= half; i += 4) {
+        __m128 c = _mm_loadu_ps(cos_stage + i);
+        __m128 s = _mm_loadu_ps(sin_stage + i);
+        __m128 rh = _mm_loadu_ps(re_high + i);
+        __m128 ih = _mm_loadu_ps(im_high + i);
+        __m128 rl = _mm_loadu_ps(re_low + i);
+        __m128 il = _mm_loadu_ps(im_low + i);
+        __m128 tr = _mm_sub_ps(_mm_mul_ps(rh, c), _mm_mul_ps(ih, s));
+        __m128 ti = _mm_add_ps(_mm_mul_ps(rh, s), _mm_mul_ps(ih, c));
+        
+        _mm_storeu_ps(re_high + i, _mm_sub_ps(rl, tr));
+        _mm_storeu_ps(im_high + i, _mm_sub_ps(il, ti));
+        _mm_storeu_ps(re_low + i, _mm_add_ps(rl, tr));
+        _mm_storeu_ps(im_low + i, _mm_add_ps(il, ti));
+    }
+#elif defined(WVS_NEON)
+    for (; i + 4 <= half; i += 4) {
+        float32x4_t c = vld1q_f32(cos_stage + i);
+        float32x4_t s = vld1q_f32(sin_stage + i);
+        float32x4_t rh = vld1q_f32(re_high + i);
+        float32x4_t ih = vld1q_f32(im_high + i);
+        float32x4_t rl = vld1q_f32(re_low + i);
+        float32x4_t il = vld1q_f32(im_low + i);
+        float32x4_t tr = vsubq_f32(vmulq_f32(rh, c), vmulq_f32(ih, s));
+        float32x4_t ti = vaddq_f32(vmulq_f32(rh, s), vmulq_f32(ih, c));
+        
+        vst1q_f32(re_high + i, vsubq_f32(rl, tr));
+        vst1q_f32(im_high + i, vsubq_f32(il, ti));
+        vst1q_f32(re_low + i, vaddq_f32(rl, tr));
+        vst1q_f32(im_low + i, vaddq_f32(il, ti));
+    }
+#endif
+    for (; i < half; i++) {
+        float c = cos_stage[i];
+        float s = sin_stage[i];
+        float tr = re_high[i] * c - im_high[i] * s;
+        float ti = re_high[i] * s + im_high[i] * c;
+        
+        re_high[i] = re_low[i] - tr;
+        im_high[i] = im_low[i] - ti;
+        re_low[i] += tr;
+        im_low[i] += ti;
+    }
+}
+
+/**
+ * wvs_spectral_features - log energies of the sub-bands of the current frame
+ *  @state: the detector state
+ */
+static void wvs_spectral_features(wvs_state *state)
+{
+    wvs_spectral *spectral = state->spectral;
+    const int n = spectral->fft_size;
+    float *re = spectral->re;
+    float *im = spectral->im;
+    int size;
+    int band;
+    int i;
+    
+    for (i = 0; i < n; i++) {
+        re[i] = 0;
+        im[i] = 0;
+    }
+    for (i = 0; i < state->samples_per_frame; i++) {
+        re[spectral->bit_reverse[i]] = spectral->frame[i] * spectral->window[i];
+    }
+    /* radix 2 decimation in time; the butterflies and the twiddles of a group are contiguous */
+    for (size = 2; size <= n; size <<= 1) {
+        int half = size / 2;
+        const float *cos_stage = spectral->cos_table + half - 1;
+        const float *sin_stage = spectral->sin_table + half - 1;
+        int start;
+        
+        for (start = 0; start < n; start += size) {
+            wvs_fft_butterflies(re + start, im + start, re + start + half, im + start + half, cos_stage, sin_stage, half);
+        }
+    }
+    for (band = 0; band < WVS_SPECTRAL_BANDS; band++) {
+        float energy = 0;
+        
+        for (i = spectral->band_first[band]; i < spectral->band_last[band]; i++) {
+            energy += re[i] * re[i] + im[i] * im[i];
+        }
+        energy /= (spectral->band_last[band] - spectral->band_first[band]) * (float)state->samples_per_frame;
+        /* floored at the power of one LSB */
+        spectral->features[band] = 10 * log10f(energy + 1.0f);
+    }
+}
+
+/**
+ * wvs_gaussian_log - log of the density of a gaussian, without the constant term
+ */
+static inline float wvs_gaussian_log(float x, float mean, float var)
+{
+    float d = x - mean;
+    
+    return -0.5f * logf(var) - d * d / (2 * var);
 }
 
-static void memory_push(int *memory, int length, int value)
+/**
+ * wvs_spectral_frame - scores the current frame against the speech and noise models and adapts them
+ *  @state: the detector state
+ *
+ *  Return 1 if the frame is speech, 0 otherwise.
+ */
+static int wvs_spectral_frame(wvs_state *state)
 {
-    while (--length) {
-        memory[length] = memory[length - 1];
+    /* adaptation rates per frame */
+    const float noise_rate = 0.05f;
+    const float speech_rate = 0.02f;
+    const float track_rate = 0.05f;
+    /* dB per frame: how fast the floor follows noise that rises for good */
+    const float floor_rise = 0.1f;
+    /* dB: the noise mean stays below floor + margin; speech models stay this far above noise;
+     log energies steadier than stationary_spread are stationary noise */
+    const float margin = 8.0f;
+    const float separation = 6.0f;
+    const float stationary_spread = 1.5f;
+    wvs_spectral *spectral = state->spectral;
+    float *x = spectral->features;
+    float ratio = 0;
+    float spread = 0;
+    int speech;
+    int band;
+    
+    wvs_spectral_features(state);
+    if (state->sequence < state->init_frames || state->sequence == 0) {
+        /* learn the noise during the first frames; speech starts well above it */
+        int n = state->sequence;
+        
+        for (band = 0; band < WVS_SPECTRAL_BANDS; band++) {
+            spectral->noise_mean[band] = (spectral->noise_mean[band] * n + x[band]) / (n + 1);
+            spectral->noise_var[band] = 9.0f;
+            spectral->speech_mean[band] = spectral->noise_mean[band] + 15.0f;
+            spectral->speech_var[band] = 36.0f;
+            spectral->track_mean[band] = spectral->noise_mean[band];
+            spectral->track_var[band] = 9.0f;
+            spectral->floor[band] = (n == 0 || x[band] < spectral->floor[band]) ? x[band] : spectral->floor[band];
+        }
+        return 0;
+    }
+    for (band = 0; band < WVS_SPECTRAL_BANDS; band++) {
+        float d = x[band] - spectral->track_mean[band];
+        
+        spectral->track_mean[band] += track_rate * d;
+        spectral->track_var[band] += track_rate * (d * d - spectral->track_var[band]);
+        spread += spectral->track_var[band];
+        ratio += wvs_band_weights[band] *
+                 (wvs_gaussian_log(x[band], spectral->speech_mean[band], spectral->speech_var[band]) -
+                  wvs_gaussian_log(x[band], spectral->noise_mean[band], spectral->noise_var[band]));
+    }
+    ratio /= spectral->weight_sum;
+    spread = sqrtf(spread / WVS_SPECTRAL_BANDS);
+    speech = ratio >= spectral->threshold && spread >= stationary_spread;
+    
+    for (band = 0; band < WVS_SPECTRAL_BANDS; band++) {
+        float d = x[band] - spectral->noise_mean[band];
+        
+        spectral->floor[band] = (x[band] < spectral->floor[band]) ? x[band] : spectral->floor[band] + floor_rise;
+        if (!speech) {
+            spectral->noise_mean[band] += noise_rate * d;
+            spectral->noise_var[band] += noise_rate * (d * d - spectral->noise_var[band]);
+        }
+        if (spectral->noise_mean[band] > spectral->floor[band] + margin) {
+            spectral->noise_mean[band] = spectral->floor[band] + margin;
+        }
+        else if (spectral->noise_mean[band] < spectral->floor[band]) {
+            spectral->noise_mean[band] = spectral->floor[band];
+        }
+        if (spectral->noise_var[band] < 1.0f) {
+            spectral->noise_var[band] = 1.0f;
+        }
+        if (speech) {
+            d = x[band] - spectral->speech_mean[band];
+            spectral->speech_mean[band] += speech_rate * d;
+            spectral->speech_var[band] += speech_rate * (d * d - spectral->speech_var[band]);
+        }
+        if (spectral->speech_mean[band] < spectral->noise_mean[band] + separation) {
+            spectral->speech_mean[band] = spectral->noise_mean[band] + separation;
+        }
+        if (spectral->speech_var[band] < 4.0f) {
+            spectral->speech_var[band] = 4.0f;
+        }
     }
-    memory[0] = value;
+    
+    return speech;
 }
 
-static int frame_memory_gte(int *memory, int value, int nb)
+#ifdef WVS_FIXED_POINT
+
+static inline wvs_energy wvs_sample_dbfs(int16_t sample)
 {
+    /* 20 * log10(2) in Q16: dB per octave of amplitude */
+    const int64_t db_per_octave = 394566;
+    uint32_t magnitude = (uint32_t)(sample < 0 ? -(int32_t)sample : sample);
+    
+    /* 20 * log10(2^15 / |sample|), from Q32 down to Q8 */
+    return (wvs_energy)(((((int64_t)15 << 16) - wvs_log2_q16(magnitude)) * db_per_octave + ((int64_t)1 << 23)) >> 24);
+}
+
+#else
+
+static inline wvs_energy wvs_sample_dbfs(int16_t sample)
+{
+    double max_ref;
+    
+    max_ref = 32768; //pow(2.0, 16.0) / 2; signed 16 bits w/o the -1
+    
+    return 0 - 20 * log10(fabs(sample / max_ref));
+}
+
+#endif
+
+#if defined(WVS_AVX2)
+
+static uint64_t wvs_sum_squares(const int16_t *samples, int size)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc = _mm256_setzero_si256();
+    __m256i x, pairs;
+    uint64_t lanes[4];
+    uint64_t sum;
     int i = 0;
     
-    for (i = 0; i < nb; i++) {
-        if (memory[i] < value) {
-            return 0;
+    for (; i + 16 <= size; i += 16) {
+        x = _mm256_loadu_si256((const __m256i *)(samples + i));
+        /* x0*x0 + x1*x1 <= 2^31 fits an unsigned 32 bits lane; widen before adding up */
+        pairs = _mm256_madd_epi16(x, x);
+        acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(pairs, zero));
+        acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(pairs, zero));
+    }
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    for (; i < size; i++) {
+        sum += (uint64_t)((int32_t)samples[i] * samples[i]);
+    }
+    
+    return sum;
+}
+
+#elif defined(WVS_SSE2)
+
+static uint64_t wvs_sum_squares(const int16_t *samples, int size)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    __m128i x, pairs;
+    uint64_t lanes[2];
+    uint64_t sum;
+    int i = 0;
+    
+    for (; i + 8 <= size; i += 8) {
+        x = _mm_loadu_si128((const __m128i *)(samples + i));
+        /* x0*x0 + x1*x1 <= 2^31 fits an unsigned 32 bits lane; widen before adding up */
+        pairs = _mm_madd_epi16(x, x);
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(pairs, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(pairs, zero));
+    }
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    sum = lanes[0] + lanes[1];
+    for (; i < size; i++) {
+        sum += (uint64_t)((int32_t)samples[i] * samples[i]);
+    }
+    
+    return sum;
+}
+
+#elif defined(WVS_NEON)
+
+static uint64_t wvs_sum_squares(const int16_t *samples, int size)
+{
+    int64x2_t acc = vdupq_n_s64(0);
+    int16x4_t x;
+    uint64_t sum;
+    int i = 0;
+    
+    for (; i + 4 <= size; i += 4) {
+        x = vld1_s16(samples + i);
+        acc = vpadalq_s32(acc, vmull_s16(x, x));
+    }
+    sum = (uint64_t)(vgetq_lane_s64(acc, 0) + vgetq_lane_s64(acc, 1));
+    for (; i < size; i++) {
+        sum += (uint64_t)((int32_t)samples[i] * samples[i]);
+    }
+    
+    return sum;
+}
+
+#else
+
+static uint64_t wvs_sum_squares(const int16_t *samples, int size)
+{
+    uint64_t sum = 0;
+    int i;
+    
+    for (i = 0; i < size; i++) {
+        sum += (uint64_t)((int32_t)samples[i] * samples[i]);
+    }
+    
+    return sum;
+}
+
+#endif
+
+#if defined(WVS_SSE2)
+
+static void wvs_sum_squares_interleaved(const int16_t *samples, int nb_samples, int nb_channels, uint64_t *sums)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc0, acc1, acc2, acc3, x, lo, hi, squares;
+    int channel = 0;
+    int i;
+    
+    /* eight channels at a time; the squares are widened to 64 bits lanes right away */
+    for (; channel + 8 <= nb_channels; channel += 8) {
+        acc0 = acc1 = acc2 = acc3 = _mm_setzero_si128();
+        for (i = 0; i < nb_samples; i++) {
+            x = _mm_loadu_si128((const __m128i *)(samples + (size_t)i * nb_channels + channel));
+            lo = _mm_mullo_epi16(x, x);
+            hi = _mm_mulhi_epi16(x, x);
+            squares = _mm_unpacklo_epi16(lo, hi);
+            acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(squares, zero));
+            acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(squares, zero));
+            squares = _mm_unpackhi_epi16(lo, hi);
+            acc2 = _mm_add_epi64(acc2, _mm_unpacklo_epi32(squares, zero));
+            acc3 = _mm_add_epi64(acc3, _mm_unpackhi_epi32(squares, zero));
+        }
+        _mm_storeu_si128((__m128i *)(sums + channel), acc0);
+        _mm_storeu_si128((__m128i *)(sums + channel + 2), acc1);
+        _mm_storeu_si128((__m128i *)(sums + channel + 4), acc2);
+        _mm_storeu_si128((__m128i *)(sums + channel + 6), acc3);
+    }
+    for (; channel < nb_channels; channel++) {
+        sums[channel] = 0;
+        for (i = 0; i < nb_samples; i++) {
+            int32_t sample = samples[(size_t)i * nb_channels + channel];
+            sums[channel] += (uint64_t)(sample * sample);
         }
     }
+}
+
+#elif defined(WVS_NEON)
+
+static void wvs_sum_squares_interleaved(const int16_t *samples, int nb_samples, int nb_channels, uint64_t *sums)
+{
+    uint64x2_t acc0, acc1;
+    uint32x4_t squares;
+    int16x4_t x;
+    int channel = 0;
+    int i;
     
-    return 1;
+    /* four channels at a time; the squares are widened to 64 bits lanes right away */
+    for (; channel + 4 <= nb_channels; channel += 4) {
+        acc0 = acc1 = vdupq_n_u64(0);
+        for (i = 0; i < nb_samples; i++) {
+            x = vld1_s16(samples + (size_t)i * nb_channels + channel);
+            squares = vreinterpretq_u32_s32(vmull_s16(x, x));
+            acc0 = vaddw_u32(acc0, vget_low_u32(squares));
+            acc1 = vaddw_u32(acc1, vget_high_u32(squares));
+        }
+        vst1q_u64(sums + channel, acc0);
+        vst1q_u64(sums + channel + 2, acc1);
+    }
+    for (; channel < nb_channels; channel++) {
+        sums[channel] = 0;
+        for (i = 0; i < nb_samples; i++) {
+            int32_t sample = samples[(size_t)i * nb_channels + channel];
+            sums[channel] += (uint64_t)(sample * sample);
+        }
+    }
 }
 
-static int frame_memory_lte(int *memory, int value, int nb)
+#else
+
+static void wvs_sum_squares_interleaved(const int16_t *samples, int nb_samples, int nb_channels, uint64_t *sums)
 {
+    int channel;
     int i;
     
-    for (i = 0; i < nb; i++) {
-        if (memory[i] > value) {
-            return 0;
+    for (channel = 0; channel < nb_channels; channel++) {
+        sums[channel] = 0;
+    }
+    for (i = 0; i < nb_samples; i++) {
+        for (channel = 0; channel < nb_channels; channel++) {
+            int32_t sample = samples[(size_t)i * nb_channels + channel];
+            sums[channel] += (uint64_t)(sample * sample);
         }
     }
+}
+
+#endif
+
+static void detector_esf_minimum(wvs_state *state, wvs_energy energy, int n)
+{
+    n = (n > state->adaptation_frames) ? state->adaptation_frames : n; //by default, this correspond to 1/10 of a second
+    state->min_energy = wvs_running_average(state->min_energy, energy, n);
+    state->min_initialized = 1;
+}
+
+static int detector_esf_check_frame(wvs_state *state, wvs_energy energy)
+{
+    int counter;
     
-    return 1;
+    counter = 0;
+    if ((0 - (energy - state->min_energy)) >= state->energy_threshold) {
+        counter++;
+    }
+    
+    return counter;
+}
+
+/**
+ * memory_push - records a frame decision in the ring buffer
+ *  @state: the detector state
+ *  @value: 1 for a speech frame, 0 otherwise
+ *
+ *  Keeps the speech frame counts of both windows up to date in O(1).
+ */
+static void memory_push(wvs_state *state, int value)
+{
+    int *memory = state->previous_state;
+    int length = state->previous_state_maxlen;
+    int head = (state->previous_state_head + 1) % length;
+    /* the decisions leaving each window; read before the oldest one is overwritten */
+    int leaving_long = memory[(head - state->stop_frames + length) % length];
+    int leaving_short = memory[(head - state->talk_frames + length) % length];
+    
+    memory[head] = value;
+    state->previous_state_head = head;
+    state->speech_frames_long += value - leaving_long;
+    state->speech_frames_short += value - leaving_short;
 }